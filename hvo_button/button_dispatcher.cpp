@@ -0,0 +1,155 @@
+#include "button_dispatcher.hpp"
+#include "button_latency.hpp"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+namespace hvo {
+
+esp_err_t ButtonDispatcher::start(UBaseType_t priority)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (task_)
+    {
+        return ESP_OK;
+    }
+    if (xTaskCreate(handler_task, "button_disp", CONFIG_HV_BUTTON_TASK_STACK_SIZE, this, priority, &task_) != pdPASS)
+    {
+        task_ = nullptr;
+        ESP_LOGE(TAG, "Failed to create handler task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ButtonDispatcher::subscribe(button_handle_t handle, uint16_t button, button_event_t event,
+                                      ButtonHandler handler)
+{
+    if (!handle || !handler)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = start();
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    uintptr_t route;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (routes_.size() > UINT16_MAX)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+        route = routes_.size();
+        routes_.push_back(std::unique_ptr<Route>(new Route{button, event, std::move(handler)}));
+    }
+    err = iot_button_register_cb(handle, event, NULL, button_cb, reinterpret_cast<void *>(route));
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Button register callback failed");
+    }
+    return err;
+}
+
+void ButtonDispatcher::button_cb(void *, void *usr_data)
+{
+    // Button timer context: no locks, no allocation
+    auto &dispatcher = getInstance();
+    uint16_t route = static_cast<uint16_t>(reinterpret_cast<uintptr_t>(usr_data));
+    Record record = {};
+    record.time_us = esp_timer_get_time();
+    record.route = route;
+    if (!dispatcher.queue_.push(record))
+    {
+        dispatcher.dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    uint16_t depth = static_cast<uint16_t>(dispatcher.queue_.size());
+    uint16_t max = dispatcher.depth_max_.load(std::memory_order_relaxed);
+    while (depth > max && !dispatcher.depth_max_.compare_exchange_weak(max, depth, std::memory_order_relaxed))
+    {
+    }
+    xTaskNotifyGive(dispatcher.task_);
+}
+
+void ButtonDispatcher::dispatch(const Record &record)
+{
+    Route *route;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (record.route >= routes_.size())
+        {
+            return;
+        }
+        route = routes_[record.route].get();
+    }
+    ButtonEvent event = {route->button, route->event, record.time_us};
+
+    int64_t start = esp_timer_get_time();
+    route->handler(event);
+    int64_t end = esp_timer_get_time();
+
+#if CONFIG_HV_BUTTON_LATENCY
+    ButtonLatency::getInstance().handled(route->button, record.time_us, start, end);
+#endif
+
+    uint32_t wait_us = static_cast<uint32_t>(start - event.time_us);
+    uint32_t handler_us = static_cast<uint32_t>(end - start);
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.events++;
+    stats_.wait_us_sum += wait_us;
+    stats_.handler_us_sum += handler_us;
+    if (wait_us > stats_.wait_us_max)
+        stats_.wait_us_max = wait_us;
+    if (handler_us > stats_.handler_us_max)
+        stats_.handler_us_max = handler_us;
+}
+
+void ButtonDispatcher::handler_task(void *arg)
+{
+    auto *dispatcher = static_cast<ButtonDispatcher *>(arg);
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        Record record;
+        while (dispatcher->queue_.pop(record))
+        {
+            dispatcher->dispatch(record);
+        }
+    }
+}
+
+ButtonDispatchStats ButtonDispatcher::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    ButtonDispatchStats stats = stats_;
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.depth = static_cast<uint16_t>(queue_.size());
+    stats.depth_max = depth_max_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ButtonDispatcher::reset_stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = {};
+    dropped_.store(0, std::memory_order_relaxed);
+    depth_max_.store(0, std::memory_order_relaxed);
+}
+
+void ButtonDispatcher::log_stats() const
+{
+    ButtonDispatchStats stats = get_stats();
+    ESP_LOGI(TAG, "events %lu, dropped %lu, queue %u (max %u of %u)", (unsigned long)stats.events,
+             (unsigned long)stats.dropped, stats.depth, stats.depth_max, (unsigned)queue_.capacity());
+    if (stats.events > 0)
+    {
+        ESP_LOGI(TAG, "wait avg %lu us, max %lu us; handler avg %lu us, max %lu us",
+                 (unsigned long)(stats.wait_us_sum / stats.events), (unsigned long)stats.wait_us_max,
+                 (unsigned long)(stats.handler_us_sum / stats.events), (unsigned long)stats.handler_us_max);
+    }
+}
+
+} // namespace hvo
@@ -0,0 +1,313 @@
+#include "button_latency.hpp"
+
+#if CONFIG_HV_BUTTON_LATENCY
+
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+
+namespace hvo {
+
+const char *latency_stage_name(LatencyStage stage)
+{
+    switch (stage)
+    {
+    case LatencyStage::DEBOUNCE:
+        return "debounce";
+    case LatencyStage::QUEUE:
+        return "queue";
+    case LatencyStage::CALLBACK:
+        return "callback";
+    case LatencyStage::TOTAL:
+        return "total";
+    }
+    return "unknown";
+}
+
+uint32_t LatencyHistogram::percentile_us(uint8_t p) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+    uint64_t target = (static_cast<uint64_t>(count) * p + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS - 1; i++)
+    {
+        seen += buckets[i];
+        if (seen >= target)
+        {
+            return 2u << i;
+        }
+    }
+    return max_us;
+}
+
+ButtonLatency::Slot *ButtonLatency::slot(uint16_t button)
+{
+    return button < CONFIG_HV_BUTTON_LATENCY_MAX_BUTTONS ? &slots_[button] : nullptr;
+}
+
+const ButtonLatency::Slot *ButtonLatency::slot(uint16_t button) const
+{
+    return button < CONFIG_HV_BUTTON_LATENCY_MAX_BUTTONS ? &slots_[button] : nullptr;
+}
+
+void ButtonLatency::record(Histogram &hist, uint32_t us)
+{
+    size_t bucket = us < 2 ? 0 : 31 - __builtin_clz(us);
+    if (bucket >= LATENCY_BUCKETS)
+        bucket = LATENCY_BUCKETS - 1;
+    hist.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    uint32_t lo = hist.sum_lo_us.fetch_add(us, std::memory_order_relaxed);
+    if (lo + us < lo)
+    {
+        hist.sum_hi_us.fetch_add(1, std::memory_order_relaxed);
+    }
+    uint32_t max = hist.max_us.load(std::memory_order_relaxed);
+    while (us > max && !hist.max_us.compare_exchange_weak(max, us, std::memory_order_relaxed))
+    {
+    }
+    hist.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ButtonLatency::edge(uint16_t button, uint32_t time_us)
+{
+    Slot *s = slot(button);
+    // Only the first edge counts, later ones are contact bounce
+    if (!s || s->edge_pending.load(std::memory_order_acquire))
+    {
+        return;
+    }
+    s->edge_us.store(time_us, std::memory_order_relaxed);
+    s->edge_pending.store(true, std::memory_order_release);
+}
+
+void IRAM_ATTR ButtonLatency::edge_isr(void *arg)
+{
+    uint16_t button = static_cast<uint16_t>(reinterpret_cast<uintptr_t>(arg));
+    Slot &s = getInstance().slots_[button];
+    if (!s.edge_pending.load(std::memory_order_acquire))
+    {
+        s.edge_us.store(now_us(), std::memory_order_relaxed);
+        s.edge_pending.store(true, std::memory_order_release);
+    }
+}
+
+void ButtonLatency::debounced_cb(void *, void *usr_data)
+{
+    // Button timer context, registered before any application callback of the button
+    uint16_t button = static_cast<uint16_t>(reinterpret_cast<uintptr_t>(usr_data));
+    Slot &s = getInstance().slots_[button];
+    uint32_t now = now_us();
+    if (s.edge_pending.load(std::memory_order_acquire))
+    {
+        uint32_t edge_us = s.edge_us.load(std::memory_order_relaxed);
+        s.edge_pending.store(false, std::memory_order_release);
+        uint32_t age = now - edge_us;
+        if (age <= EDGE_MAX_AGE_US)
+        {
+            record(s.stage[static_cast<size_t>(LatencyStage::DEBOUNCE)], age);
+            s.last_edge_us.store(edge_us, std::memory_order_relaxed);
+            s.last_edge_valid.store(true, std::memory_order_release);
+            return;
+        }
+    }
+    // No edge seen (power save GPIO) or a stale one: no total for the following handlers
+    s.last_edge_valid.store(false, std::memory_order_release);
+}
+
+esp_err_t ButtonLatency::attach(button_handle_t handle, uint16_t button)
+{
+    if (!slot(button))
+    {
+        ESP_LOGW(TAG, "Button %u not tracked, raise HV_BUTTON_LATENCY_MAX_BUTTONS", button);
+        return ESP_ERR_NO_MEM;
+    }
+    void *arg = reinterpret_cast<void *>(static_cast<uintptr_t>(button));
+    esp_err_t err = iot_button_register_cb(handle, BUTTON_PRESS_DOWN, NULL, debounced_cb, arg);
+    if (err == ESP_OK)
+        err = iot_button_register_cb(handle, BUTTON_PRESS_UP, NULL, debounced_cb, arg);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Button register callback failed");
+        return err;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (report_timer_)
+        {
+            return ESP_OK;
+        }
+    }
+    return start_report();
+}
+
+esp_err_t ButtonLatency::attach_gpio(int32_t gpio, uint16_t button)
+{
+    if (!slot(button))
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    gpio_num_t num = static_cast<gpio_num_t>(gpio);
+    esp_err_t err = gpio_install_isr_service(0);
+    if (err == ESP_ERR_INVALID_STATE)
+        err = ESP_OK; // installed by someone else
+    if (err == ESP_OK)
+        err = gpio_set_intr_type(num, GPIO_INTR_ANYEDGE);
+    if (err == ESP_OK)
+        err = gpio_isr_handler_add(num, edge_isr, reinterpret_cast<void *>(static_cast<uintptr_t>(button)));
+    if (err == ESP_OK)
+        err = gpio_intr_enable(num);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Edge interrupt on GPIO %ld failed: %s", (long)gpio, esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t ButtonLatency::register_cb(button_handle_t handle, uint16_t button, button_event_t event,
+                                     button_cb_t callback, void *user_data)
+{
+    if (!slot(button))
+    {
+        return iot_button_register_cb(handle, event, NULL, callback, user_data);
+    }
+    TimedCb *timed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        timed_cbs_.push_back(std::unique_ptr<TimedCb>(new TimedCb{button, callback, user_data}));
+        timed = timed_cbs_.back().get();
+    }
+    return iot_button_register_cb(handle, event, NULL, timed_cb, timed);
+}
+
+void ButtonLatency::timed_cb(void *button_handle, void *usr_data)
+{
+    // Direct callbacks run where the event is detected, so there is no queue stage
+    auto *timed = static_cast<TimedCb *>(usr_data);
+    int64_t start = esp_timer_get_time();
+    timed->callback(button_handle, timed->user_data);
+    int64_t end = esp_timer_get_time();
+    getInstance().handled(timed->button, start, start, end);
+}
+
+void ButtonLatency::handled(uint16_t button, int64_t detected_us, int64_t start_us, int64_t end_us)
+{
+    Slot *s = slot(button);
+    if (!s)
+    {
+        return;
+    }
+    if (start_us > detected_us)
+    {
+        record(s->stage[static_cast<size_t>(LatencyStage::QUEUE)], static_cast<uint32_t>(start_us - detected_us));
+    }
+    record(s->stage[static_cast<size_t>(LatencyStage::CALLBACK)], static_cast<uint32_t>(end_us - start_us));
+    if (s->last_edge_valid.load(std::memory_order_acquire))
+    {
+        uint32_t edge_us = s->last_edge_us.load(std::memory_order_relaxed);
+        record(s->stage[static_cast<size_t>(LatencyStage::TOTAL)], static_cast<uint32_t>(start_us) - edge_us);
+    }
+}
+
+bool ButtonLatency::get_stats(uint16_t button, ButtonLatencyStats &stats) const
+{
+    const Slot *s = slot(button);
+    if (!s)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < LATENCY_STAGE_COUNT; i++)
+    {
+        const Histogram &hist = s->stage[i];
+        LatencyHistogram &out = stats.stage[i];
+        out.count = hist.count.load(std::memory_order_relaxed);
+        out.max_us = hist.max_us.load(std::memory_order_relaxed);
+        // The words are read separately, a carry in flight shows up on the next read
+        out.sum_us = (static_cast<uint64_t>(hist.sum_hi_us.load(std::memory_order_relaxed)) << 32) |
+                     hist.sum_lo_us.load(std::memory_order_relaxed);
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++)
+        {
+            out.buckets[b] = hist.buckets[b].load(std::memory_order_relaxed);
+        }
+    }
+    return true;
+}
+
+void ButtonLatency::reset()
+{
+    for (Slot &s : slots_)
+    {
+        for (Histogram &hist : s.stage)
+        {
+            hist.count.store(0, std::memory_order_relaxed);
+            hist.max_us.store(0, std::memory_order_relaxed);
+            hist.sum_lo_us.store(0, std::memory_order_relaxed);
+            hist.sum_hi_us.store(0, std::memory_order_relaxed);
+            for (auto &bucket : hist.buckets)
+            {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
+
+void ButtonLatency::log_report() const
+{
+    ButtonLatencyStats stats;
+    for (uint16_t button = 0; button < CONFIG_HV_BUTTON_LATENCY_MAX_BUTTONS; button++)
+    {
+        get_stats(button, stats);
+        for (size_t i = 0; i < LATENCY_STAGE_COUNT; i++)
+        {
+            const LatencyHistogram &hist = stats.stage[i];
+            if (hist.count == 0)
+            {
+                continue;
+            }
+            ESP_LOGI(TAG, "button %u %-8s n %lu avg %lu us, p50 < %lu us, p99 < %lu us, max %lu us", button,
+                     latency_stage_name(static_cast<LatencyStage>(i)), (unsigned long)hist.count,
+                     (unsigned long)(hist.sum_us / hist.count), (unsigned long)hist.percentile_us(50),
+                     (unsigned long)hist.percentile_us(99), (unsigned long)hist.max_us);
+        }
+    }
+}
+
+void ButtonLatency::report_cb(void *arg)
+{
+    static_cast<ButtonLatency *>(arg)->log_report();
+}
+
+esp_err_t ButtonLatency::start_report(uint32_t period_s)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!report_timer_)
+    {
+        esp_timer_create_args_t args = {};
+        args.callback = report_cb;
+        args.arg = this;
+        args.dispatch_method = ESP_TIMER_TASK;
+        args.name = "button_latency";
+        esp_err_t err = esp_timer_create(&args, &report_timer_);
+        if (err != ESP_OK)
+        {
+            report_timer_ = nullptr;
+            return err;
+        }
+    }
+    if (esp_timer_is_active(report_timer_))
+    {
+        esp_timer_stop(report_timer_);
+    }
+    if (period_s == 0)
+    {
+        return ESP_OK;
+    }
+    return esp_timer_start_periodic(report_timer_, static_cast<uint64_t>(period_s) * 1000000);
+}
+
+} // namespace hvo
+
+#endif // CONFIG_HV_BUTTON_LATENCY
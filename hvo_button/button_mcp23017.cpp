@@ -0,0 +1,233 @@
+#include "button_mcp23017.hpp"
+#include "button_latency.hpp"
+#include "driver/gpio.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "mcp23017.hpp"
+#include <chrono>
+
+namespace hvo {
+
+esp_err_t McpButtonPort::configure_pins(uint16_t mask)
+{
+    auto &mcp = MCP23017::getInstance();
+    auto lock = mcp.lock(std::chrono::milliseconds(100));
+    if (!lock)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Other pins keep their direction and pull-up
+    uint8_t dir_a;
+    uint8_t dir_b;
+    uint8_t pu_a;
+    uint8_t pu_b;
+    esp_err_t err = mcp.readPortADirection(dir_a);
+    if (err == ESP_OK)
+        err = mcp.readPortBDirection(dir_b);
+    if (err == ESP_OK)
+        err = mcp.readPullUpA(pu_a);
+    if (err == ESP_OK)
+        err = mcp.readPullUpB(pu_b);
+    if (err == ESP_OK)
+        err = mcp.setPortADirection(dir_a | (mask & 0xFF));
+    if (err == ESP_OK)
+        err = mcp.setPortBDirection(dir_b | (mask >> 8));
+    if (err == ESP_OK)
+        err = mcp.setPullUpA(pu_a | (mask & 0xFF));
+    if (err == ESP_OK)
+        err = mcp.setPullUpB(pu_b | (mask >> 8));
+    if (err == ESP_OK && int_gpio_ >= 0)
+        err = mcp.setInterruptOnChange(mask);
+    return err;
+}
+
+esp_err_t McpButtonPort::start(uint16_t pin_mask, int int_gpio)
+{
+    if (!MCP23017::getInstance().isInitialized())
+    {
+        ESP_LOGE(TAG, "MCP23017 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (task_ && int_gpio >= 0 && int_gpio != int_gpio_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!task_)
+    {
+        int_gpio_ = int_gpio;
+    }
+
+    uint16_t mask = pin_mask_ | pin_mask;
+    esp_err_t err = configure_pins(mask);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to configure pins: %s", esp_err_to_name(err));
+        return err;
+    }
+    pin_mask_ = mask;
+    // A valid snapshot before the first button polls it
+    read_ports();
+    if (task_)
+    {
+        xTaskNotifyGive(task_);
+        return ESP_OK;
+    }
+
+    if (xTaskCreate(reader_task, "mcp_buttons", CONFIG_HV_BUTTON_MCP_TASK_STACK_SIZE, this,
+                    CONFIG_HV_BUTTON_MCP_TASK_PRIORITY, &task_) != pdPASS)
+    {
+        task_ = nullptr;
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (int_gpio_ >= 0)
+    {
+        gpio_config_t io_conf = {};
+        io_conf.pin_bit_mask = 1ULL << int_gpio_;
+        io_conf.mode = GPIO_MODE_INPUT;
+        io_conf.pull_up_en = GPIO_PULLUP_ENABLE; // INTA is open drain
+        io_conf.intr_type = GPIO_INTR_NEGEDGE;
+        err = gpio_config(&io_conf);
+        if (err == ESP_OK)
+        {
+            err = gpio_install_isr_service(0);
+            if (err == ESP_ERR_INVALID_STATE)
+                err = ESP_OK; // installed by someone else
+        }
+        if (err == ESP_OK)
+            err = gpio_isr_handler_add(static_cast<gpio_num_t>(int_gpio_), int_isr, this);
+        if (err != ESP_OK)
+        {
+            // The reader task keeps polling at the fallback rate
+            ESP_LOGE(TAG, "Interrupt on GPIO %d failed: %s", int_gpio_, esp_err_to_name(err));
+        }
+    }
+    ESP_LOGI(TAG, "Buttons on pins 0x%04X, %s", pin_mask_, int_gpio_ >= 0 ? "interrupt" : "polled");
+    return ESP_OK;
+}
+
+void McpButtonPort::read_ports()
+{
+    auto &mcp = MCP23017::getInstance();
+    auto lock = mcp.lock(std::chrono::milliseconds(CONFIG_HV_BUTTON_MCP_POLL_MS));
+    uint16_t value;
+    if (!lock || mcp.readPorts(value) != ESP_OK)
+    {
+        // Keep the last snapshot, a single missed read only delays the buttons by one tick
+        errors_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    uint16_t previous = levels_.exchange(value, std::memory_order_relaxed);
+#if CONFIG_HV_BUTTON_LATENCY
+    // Edge time: the interrupt if there was one, otherwise this read (late by up to a poll period)
+    uint32_t time_us = int_pending_.exchange(false, std::memory_order_acquire)
+                           ? int_us_.load(std::memory_order_relaxed)
+                           : ButtonLatency::now_us();
+    for (uint16_t changed = previous ^ value; changed; changed &= changed - 1)
+    {
+        uint16_t traced = traced_[__builtin_ctz(changed)].load(std::memory_order_relaxed);
+        if (traced)
+        {
+            ButtonLatency::getInstance().edge(traced - 1, time_us);
+        }
+    }
+#else
+    (void)previous;
+#endif
+    reads_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void McpButtonPort::reader_task(void *arg)
+{
+    auto *port = static_cast<McpButtonPort *>(arg);
+    // Rounded up to whole ticks, at least one: pdMS_TO_TICKS(5) is 0 at 100 Hz
+    TickType_t poll_ticks = (static_cast<uint64_t>(CONFIG_HV_BUTTON_MCP_POLL_MS) * configTICK_RATE_HZ + 999) / 1000;
+    if (poll_ticks == 0)
+        poll_ticks = 1;
+    TickType_t last_wake = xTaskGetTickCount();
+    for (;;)
+    {
+        if (port->int_gpio_ >= 0)
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(INT_FALLBACK_POLL_MS));
+        }
+        else
+        {
+            vTaskDelayUntil(&last_wake, poll_ticks);
+        }
+        port->read_ports();
+    }
+}
+
+void IRAM_ATTR McpButtonPort::int_isr(void *arg)
+{
+    auto *port = static_cast<McpButtonPort *>(arg);
+#if CONFIG_HV_BUTTON_LATENCY
+    if (!port->int_pending_.load(std::memory_order_relaxed))
+    {
+        port->int_us_.store(ButtonLatency::now_us(), std::memory_order_relaxed);
+        port->int_pending_.store(true, std::memory_order_release);
+    }
+#endif
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(port->task_, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+uint8_t McpButtonPort::get_key_level(button_driver_t *driver)
+{
+    // Called from the iot_button timer for every tick: no bus access here
+    auto *d = reinterpret_cast<Driver *>(driver);
+    uint8_t level = (getInstance().snapshot() >> d->pin) & 1;
+    return level == d->active_level ? 1 : 0;
+}
+
+esp_err_t McpButtonPort::del(button_driver_t *driver)
+{
+    delete reinterpret_cast<Driver *>(driver);
+    return ESP_OK;
+}
+
+#if CONFIG_HV_BUTTON_LATENCY
+void McpButtonPort::trace(McpPin pin, uint16_t button)
+{
+    if (pin.num < 16)
+    {
+        traced_[pin.num].store(button + 1, std::memory_order_relaxed);
+    }
+}
+#endif
+
+esp_err_t McpButtonPort::new_button(McpPin pin, uint8_t active_level, const button_config_t &config,
+                                    button_handle_t &handle)
+{
+    if (pin.num > 15)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!task_ || !(pin_mask_ & (1u << pin.num)))
+    {
+        esp_err_t err = start(1u << pin.num);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+
+    auto *driver = new Driver{};
+    driver->base.get_key_level = get_key_level;
+    driver->base.del = del;
+    driver->pin = pin.num;
+    driver->active_level = active_level;
+    esp_err_t err = iot_button_create(&config, &driver->base, &handle);
+    if (err != ESP_OK)
+    {
+        delete driver;
+    }
+    return err;
+}
+
+} // namespace hvo
@@ -1,6 +1,13 @@
 #include "button_gpio.h"
 #include "iot_button.h"
 #include "esp_log.h"
+#include "button_dispatcher.hpp"
+#include "button_latency.hpp"
+#include "sdkconfig.h"
+#if CONFIG_HV_BUTTON_MCP23017
+#include "button_mcp23017.hpp"
+#endif
+#include <atomic>
 
 namespace hvo {
 
@@ -11,7 +18,18 @@ private:
     button_gpio_config_t gpio_config;
     button_config_t config;
     void *user_data_;
+    uint16_t id_;
     static constexpr const char *TAG = "Button";
+    static inline std::atomic<uint16_t> next_id_{0};
+
+    esp_err_t register_cb(button_event_t event_type, button_cb_t callback)
+    {
+#if CONFIG_HV_BUTTON_LATENCY
+        return ButtonLatency::getInstance().register_cb(handle, id_, event_type, callback, user_data_);
+#else
+        return iot_button_register_cb(handle, event_type, NULL, callback, user_data_);
+#endif
+    }
 
 public:
     Button(const Button &) = delete;
@@ -26,7 +44,7 @@ public:
 
     Button(int32_t gpio, int32_t active_level, button_event_t event_type, button_cb_t callback,
            void *user_data = nullptr, bool enable_power_save = true, bool disable_pull = false)
-        : user_data_(user_data ? user_data : this)
+        : user_data_(user_data ? user_data : this), id_(next_id_++)
     {
         gpio_config = {};
         gpio_config.active_level = active_level;
@@ -40,16 +58,64 @@ public:
         {
             ESP_LOGE(TAG, "Button initialization failed");
         }
-        err = iot_button_register_cb(handle, event_type, NULL, callback, user_data_);
+#if CONFIG_HV_BUTTON_LATENCY
+        // Before any callback, so handlers of the same event see this press
+        ButtonLatency::getInstance().attach(handle, id_);
+        if (enable_power_save)
+        {
+            // button_gpio owns the pin interrupt for wake-up
+            ESP_LOGW(TAG, "GPIO %ld: no edge time stamps with power save", (long)gpio);
+        }
+        else
+        {
+            ButtonLatency::getInstance().attach_gpio(gpio, id_);
+        }
+#endif
+        // Without a callback, handlers are added with on()
+        if (callback)
+        {
+            err = register_cb(event_type, callback);
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Button register callback failed");
+            }
+        }
+    }
+
+#if CONFIG_HV_BUTTON_MCP23017
+    // Button on an MCP23017 input, read from the shared McpButtonPort snapshot. Start the
+    // port first to use its interrupt line, otherwise it is polled.
+    Button(McpPin pin, int32_t active_level, button_event_t event_type, button_cb_t callback,
+           void *user_data = nullptr)
+        : user_data_(user_data ? user_data : this), id_(next_id_++)
+    {
+        gpio_config = {};
+        config = {};
+        handle = nullptr;
+        esp_err_t err = McpButtonPort::getInstance().new_button(pin, active_level, config, handle);
         if (err != ESP_OK)
         {
-            ESP_LOGE(TAG, "Button register callback failed");
+            ESP_LOGE(TAG, "Button initialization failed");
+            return;
+        }
+#if CONFIG_HV_BUTTON_LATENCY
+        ButtonLatency::getInstance().attach(handle, id_);
+        McpButtonPort::getInstance().trace(pin, id_);
+#endif
+        if (callback)
+        {
+            err = register_cb(event_type, callback);
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Button register callback failed");
+            }
         }
     }
+#endif
 
     esp_err_t register_callback(button_event_t event_type, button_cb_t callback)
     {
-        esp_err_t err = iot_button_register_cb(handle, event_type, NULL, callback, user_data_);
+        esp_err_t err = register_cb(event_type, callback);
         if (err != ESP_OK)
         {
             ESP_LOGE(TAG, "Button register callback failed");
@@ -57,6 +123,16 @@ public:
         return err;
     }
 
+    // handler runs in the ButtonDispatcher task instead of the button timer, so it may take
+    // its time without delaying the detection of other buttons
+    esp_err_t on(button_event_t event_type, ButtonHandler handler)
+    {
+        return ButtonDispatcher::getInstance().subscribe(handle, id_, event_type, std::move(handler));
+    }
+
+    // Identifies the button in ButtonEvent
+    uint16_t id() const { return id_; }
+
     button_event_t get_event()
     {
         return iot_button_get_event(handle);
@@ -0,0 +1,99 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "iot_button.h"
+#include "lockfree_queue.hpp"
+#include "sdkconfig.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace hvo {
+
+struct ButtonEvent
+{
+    uint16_t button;      // Button::id()
+    button_event_t event;
+    int64_t time_us;      // esp_timer_get_time() when iot_button detected the event
+};
+
+using ButtonHandler = std::function<void(const ButtonEvent &)>;
+
+// Since start() or reset_stats()
+struct ButtonDispatchStats
+{
+    uint32_t events;         // handled
+    uint32_t dropped;        // queue was full
+    uint16_t depth;          // events waiting now
+    uint16_t depth_max;
+    uint32_t wait_us_max;    // detection to handler start
+    uint64_t wait_us_sum;    // average = wait_us_sum / events
+    uint32_t handler_us_max; // handler run time
+    uint64_t handler_us_sum;
+};
+
+/**
+ * @brief Runs button handlers in their own task
+ *
+ * The callback registered with iot_button only stores a small event record in a lock-free
+ * queue and wakes the handler task, so a slow handler never delays the detection of other
+ * button events. Handlers run one after the other in the order of detection.
+ */
+class ButtonDispatcher
+{
+public:
+    static ButtonDispatcher &getInstance()
+    {
+        static ButtonDispatcher instance;
+        return instance;
+    }
+
+    ButtonDispatcher(const ButtonDispatcher &) = delete;
+    ButtonDispatcher &operator=(const ButtonDispatcher &) = delete;
+
+    // Creates the handler task; subscribe() does this with the Kconfig priority if needed
+    esp_err_t start(UBaseType_t priority = CONFIG_HV_BUTTON_TASK_PRIORITY);
+    // Calls handler from the handler task whenever event is detected on handle
+    esp_err_t subscribe(button_handle_t handle, uint16_t button, button_event_t event, ButtonHandler handler);
+
+    ButtonDispatchStats get_stats() const;
+    void reset_stats();
+    void log_stats() const;
+
+private:
+    struct Route
+    {
+        uint16_t button;
+        button_event_t event;
+        ButtonHandler handler;
+    };
+    // Queue entry; button and event follow from the route
+    struct Record
+    {
+        int64_t time_us;
+        uint16_t route;
+    };
+
+    static constexpr const char *TAG = "ButtonDispatcher";
+
+    ButtonDispatcher() : task_(nullptr), dropped_(0), depth_max_(0), stats_{} {}
+
+    static void button_cb(void *button_handle, void *usr_data);
+    static void handler_task(void *arg);
+    void dispatch(const Record &record);
+
+    TaskHandle_t task_;
+    LockFreeQueue<Record, queue_size_pow2(CONFIG_HV_BUTTON_QUEUE_LEN)> queue_;
+    std::vector<std::unique_ptr<Route>> routes_; // index = route id, never shrinks
+    // Written by the detecting side, which must not block
+    std::atomic<uint32_t> dropped_;
+    std::atomic<uint16_t> depth_max_;
+    ButtonDispatchStats stats_; // handler side
+    mutable std::mutex mutex_;
+};
+
+} // namespace hvo
@@ -0,0 +1,134 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "iot_button.h"
+#include "sdkconfig.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if CONFIG_HV_BUTTON_LATENCY
+
+namespace hvo {
+
+enum class LatencyStage : uint8_t
+{
+    DEBOUNCE, // first pin edge to the debounced press or release
+    QUEUE,    // event detection to handler start (Button::on() handlers only)
+    CALLBACK, // handler run time
+    TOTAL,    // pin edge of the press or release to handler start
+};
+
+constexpr size_t LATENCY_STAGE_COUNT = 4;
+// Bucket 0 holds 0-1 us, bucket i holds [2^i, 2^(i+1)) us, the last one everything above
+constexpr size_t LATENCY_BUCKETS = 20;
+
+const char *latency_stage_name(LatencyStage stage);
+
+struct LatencyHistogram
+{
+    uint32_t count;
+    uint32_t max_us;
+    uint64_t sum_us; // average = sum_us / count
+    uint32_t buckets[LATENCY_BUCKETS];
+
+    // Upper bound of the bucket that holds the p-th percentile, 0 without samples
+    uint32_t percentile_us(uint8_t p) const;
+};
+
+// Since the first event or reset()
+struct ButtonLatencyStats
+{
+    LatencyHistogram stage[LATENCY_STAGE_COUNT];
+};
+
+/**
+ * @brief Latency from a physical press to the application handler, per button
+ *
+ * Pin edges are time stamped in the GPIO interrupt (or when the MCP23017 port snapshot
+ * changes), the debounced press and release when iot_button reports them, and handlers
+ * when they start and return. Every stage goes into a log2 histogram per button. All
+ * recording is lock-free, so it is safe from the button timer and from interrupts.
+ *
+ * Only compiled in with CONFIG_HV_BUTTON_LATENCY; Button wires everything up.
+ */
+class ButtonLatency
+{
+public:
+    static ButtonLatency &getInstance()
+    {
+        static ButtonLatency instance;
+        return instance;
+    }
+
+    ButtonLatency(const ButtonLatency &) = delete;
+    ButtonLatency &operator=(const ButtonLatency &) = delete;
+
+    // Buttons with an id of CONFIG_HV_BUTTON_LATENCY_MAX_BUTTONS or above are not tracked
+    bool get_stats(uint16_t button, ButtonLatencyStats &stats) const;
+    void reset();
+    void log_report() const;
+    // Calls log_report() every period_s seconds, 0 stops it
+    esp_err_t start_report(uint32_t period_s = CONFIG_HV_BUTTON_LATENCY_REPORT_S);
+
+    // Hooks for Button, ButtonDispatcher and McpButtonPort
+    esp_err_t attach(button_handle_t handle, uint16_t button);
+    esp_err_t attach_gpio(int32_t gpio, uint16_t button);
+    esp_err_t register_cb(button_handle_t handle, uint16_t button, button_event_t event, button_cb_t callback,
+                          void *user_data);
+    void edge(uint16_t button, uint32_t time_us);
+    void handled(uint16_t button, int64_t detected_us, int64_t start_us, int64_t end_us);
+
+    // Lower 32 bits of esp_timer_get_time(): differences stay correct across the wrap
+    static uint32_t now_us() { return static_cast<uint32_t>(esp_timer_get_time()); }
+
+private:
+    struct Histogram
+    {
+        std::atomic<uint32_t> count;
+        std::atomic<uint32_t> max_us;
+        // 64 bit sum from two words, 64 bit atomics are not lock-free on Xtensa
+        std::atomic<uint32_t> sum_lo_us;
+        std::atomic<uint32_t> sum_hi_us; // carries of sum_lo_us
+        std::atomic<uint32_t> buckets[LATENCY_BUCKETS];
+    };
+    struct Slot
+    {
+        std::atomic<uint32_t> edge_us;      // first edge not yet matched by a debounced event
+        std::atomic<bool> edge_pending;
+        std::atomic<uint32_t> last_edge_us; // edge of the last debounced press or release
+        std::atomic<bool> last_edge_valid;
+        Histogram stage[LATENCY_STAGE_COUNT];
+    };
+    struct TimedCb
+    {
+        uint16_t button;
+        button_cb_t callback;
+        void *user_data;
+    };
+
+    static constexpr const char *TAG = "ButtonLatency";
+    // Edges older than this when the debounced event arrives belong to something else
+    static constexpr uint32_t EDGE_MAX_AGE_US = 1000000;
+
+    ButtonLatency() : slots_{}, report_timer_(nullptr) {}
+
+    Slot *slot(uint16_t button);
+    const Slot *slot(uint16_t button) const;
+    static void record(Histogram &hist, uint32_t us);
+    static void edge_isr(void *arg);
+    static void debounced_cb(void *button_handle, void *usr_data);
+    static void timed_cb(void *button_handle, void *usr_data);
+    static void report_cb(void *arg);
+
+    Slot slots_[CONFIG_HV_BUTTON_LATENCY_MAX_BUTTONS];
+    std::vector<std::unique_ptr<TimedCb>> timed_cbs_; // never shrinks, iot_button keeps pointers
+    esp_timer_handle_t report_timer_;
+    std::mutex mutex_; // timed_cbs_, report_timer_
+};
+
+} // namespace hvo
+
+#endif // CONFIG_HV_BUTTON_LATENCY
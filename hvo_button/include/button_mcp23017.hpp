@@ -0,0 +1,95 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "iot_button.h"
+#include "sdkconfig.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#if CONFIG_HV_BUTTON_MCP23017
+
+namespace hvo {
+
+// MCP23017 input for Button: 0-7 = GPA0-7, 8-15 = GPB0-7
+struct McpPin
+{
+    uint8_t num;
+};
+
+/**
+ * @brief Shared input snapshot of the MCP23017 for iot_button
+ *
+ * One task reads both ports in a single I2C transaction and keeps the result in an atomic.
+ * The iot_button driver of each expander button only tests its bit in that snapshot, so its
+ * timer never waits on the bus and one read serves all 16 pins.
+ *
+ * Without an interrupt line the ports are read every CONFIG_HV_BUTTON_MCP_POLL_MS. With
+ * INTA wired to int_gpio they are read on every interrupt-on-change, plus a slow poll in case
+ * an edge was missed.
+ */
+class McpButtonPort
+{
+public:
+    static McpButtonPort &getInstance()
+    {
+        static McpButtonPort instance;
+        return instance;
+    }
+
+    McpButtonPort(const McpButtonPort &) = delete;
+    McpButtonPort &operator=(const McpButtonPort &) = delete;
+
+    // Makes the pins in mask inputs with pull-ups and starts the reader task.
+    // MCP23017::init() must have been called before. Later calls add pins.
+    esp_err_t start(uint16_t pin_mask, int int_gpio = -1);
+    // iot_button device for one pin; the port is started with that pin if needed
+    esp_err_t new_button(McpPin pin, uint8_t active_level, const button_config_t &config, button_handle_t &handle);
+
+    uint16_t snapshot() const { return levels_.load(std::memory_order_relaxed); }
+    uint32_t reads() const { return reads_.load(std::memory_order_relaxed); }
+    uint32_t errors() const { return errors_.load(std::memory_order_relaxed); }
+
+#if CONFIG_HV_BUTTON_LATENCY
+    // Reports level changes of pin as edges of button to ButtonLatency
+    void trace(McpPin pin, uint16_t button);
+#endif
+
+private:
+    struct Driver
+    {
+        button_driver_t base; // first member, iot_button passes a pointer to it
+        uint8_t pin;
+        uint8_t active_level;
+    };
+
+    static constexpr const char *TAG = "McpButtonPort";
+    static constexpr uint32_t INT_FALLBACK_POLL_MS = 100;
+
+    McpButtonPort() : task_(nullptr), pin_mask_(0), int_gpio_(-1), levels_(0xFFFF), reads_(0), errors_(0) {}
+
+    esp_err_t configure_pins(uint16_t mask);
+    void read_ports();
+    static void reader_task(void *arg);
+    static void int_isr(void *arg);
+    static uint8_t get_key_level(button_driver_t *driver);
+    static esp_err_t del(button_driver_t *driver);
+
+    TaskHandle_t task_;
+    uint16_t pin_mask_;
+    int int_gpio_;
+    std::atomic<uint16_t> levels_; // pulled-up inputs idle high
+    std::atomic<uint32_t> reads_;
+    std::atomic<uint32_t> errors_;
+    std::mutex mutex_; // start()
+#if CONFIG_HV_BUTTON_LATENCY
+    std::atomic<uint32_t> int_us_{0};      // interrupt time of the pending read
+    std::atomic<bool> int_pending_{false};
+    std::atomic<uint16_t> traced_[16] = {}; // button id + 1, 0 = not traced
+#endif
+};
+
+} // namespace hvo
+
+#endif // CONFIG_HV_BUTTON_MCP23017
@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace hvo {
+
+// Smallest power of two of at least n, for sizes that come from configuration
+constexpr size_t queue_size_pow2(size_t n)
+{
+    size_t size = 2;
+    while (size < n)
+        size <<= 1;
+    return size;
+}
+
+/**
+ * @brief Bounded lock-free queue for several producers and consumers
+ *
+ * Every cell carries a sequence number that tells producers and consumers whether it is
+ * free or filled for their turn (D. Vyukov's bounded MPMC queue). push() and pop() never
+ * block and never allocate; push() fails when the queue is full.
+ */
+template <typename T, size_t N>
+class LockFreeQueue
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "queue size must be a power of two");
+
+    struct Cell
+    {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    Cell cells_[N];
+    std::atomic<size_t> head_; // next push position
+    std::atomic<size_t> tail_; // next pop position
+
+public:
+    LockFreeQueue() : head_(0), tail_(0)
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    LockFreeQueue(const LockFreeQueue &) = delete;
+    LockFreeQueue &operator=(const LockFreeQueue &) = delete;
+
+    bool push(const T &value)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;)
+        {
+            cell = &cells_[pos & (N - 1)];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = value;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;)
+        {
+            cell = &cells_[pos & (N - 1)];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (diff < 0)
+            {
+                return false; // empty
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        value = cell->data;
+        cell->seq.store(pos + N, std::memory_order_release);
+        return true;
+    }
+
+    // Snapshot, may be off by the operations running concurrently
+    size_t size() const
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        return head >= tail ? head - tail : 0;
+    }
+
+    static constexpr size_t capacity() { return N; }
+};
+
+} // namespace hvo
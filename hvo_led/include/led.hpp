@@ -5,6 +5,7 @@
 
 #include "driver/gpio.h"
 #include "gpio_cxx.hpp"
+#include "led_pattern.hpp"
 
 namespace hvo {
 
@@ -14,18 +15,23 @@ typedef enum class LedState
     off,
 } led_state_t;
 
+class LedGroup;
+
 class Led
 {
+    friend class LedGroup;
+
     idf::GPIO_Output gpio_pin_;
     led_state_t led_state_;
     bool is_active_high_{true};
+    uint32_t pin_;
 
 public:
-    Led(uint32_t pin) : gpio_pin_(idf::GPIONum(pin)), led_state_(LedState::off)
+    Led(uint32_t pin) : gpio_pin_(idf::GPIONum(pin)), led_state_(LedState::off), pin_(pin)
     {
     }
 
-    Led(uint32_t pin, bool is_active_high) : gpio_pin_(idf::GPIONum(pin)), led_state_(LedState::off)
+    Led(uint32_t pin, bool is_active_high) : gpio_pin_(idf::GPIONum(pin)), led_state_(LedState::off), pin_(pin)
     {
         is_active_high_ = is_active_high;
     }
@@ -68,7 +74,16 @@ public:
         }
     }
 
+    // Blocks the calling task for 2 * duration_ms * count
     void blink(uint32_t duration_ms = 500, uint32_t count = 1);
+    // Same pattern, played by LedPatternEngine; returns immediately. count 0 blinks
+    // nothing and returns ESP_ERR_INVALID_ARG.
+    esp_err_t blink_async(uint32_t duration_ms = 500, uint32_t count = 1);
+    esp_err_t play(const LedPattern &pattern);
+    // Ends a running pattern and restores the state from before it
+    void stop_pattern();
+
+    ~Led();
 };
 
 } // namespace hvo
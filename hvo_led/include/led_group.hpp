@@ -0,0 +1,49 @@
+#ifndef LED_GROUP_HPP
+#define LED_GROUP_HPP
+
+#include <stdint.h>
+
+#include <cstddef>
+#include <initializer_list>
+#include <vector>
+
+#include "led.hpp"
+
+namespace hvo {
+
+static constexpr size_t LED_GROUP_MAX = 32;
+
+/**
+ * @brief Several Led objects switched together
+ *
+ * set() builds one set mask and one clear mask per GPIO bank and writes each to the
+ * W1TS / W1TC register once, so all LEDs of a bank change in the same cycle instead of one
+ * after the other. Active-low LEDs are inverted while the masks are built.
+ *
+ * The Led objects must outlive the group. Their state() follows the group writes.
+ */
+class LedGroup
+{
+    std::vector<Led *> leds_;
+    uint32_t pattern_;
+
+public:
+    LedGroup() : pattern_(0) {}
+    LedGroup(std::initializer_list<Led *> leds);
+
+    // Up to LED_GROUP_MAX LEDs, returns false if the group is full
+    bool add(Led &led);
+    size_t size() const { return leds_.size(); }
+
+    // Bit i switches the i-th LED in order of add()
+    void set(uint32_t pattern);
+    uint32_t get() const { return pattern_; }
+    void all_on();
+    void all_off();
+    // The first count LEDs on, the others off
+    void bar(size_t count);
+};
+
+} // namespace hvo
+
+#endif // LED_GROUP_HPP
@@ -0,0 +1,113 @@
+#ifndef LED_PATTERN_HPP
+#define LED_PATTERN_HPP
+
+#include <stdint.h>
+
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <vector>
+
+#include "esp_err.h"
+#include "esp_timer.h"
+
+namespace hvo {
+
+class Led;
+
+// One step of a pattern: the LED is switched on or off and held for ms
+struct LedStep
+{
+    bool on;
+    uint16_t ms;
+};
+
+class LedPattern
+{
+    std::vector<LedStep> steps_;
+    uint32_t repeat_; // 0 = until stopped or replaced
+
+public:
+    LedPattern(std::initializer_list<LedStep> steps, uint32_t repeat = 1) : steps_(steps), repeat_(repeat)
+    {
+    }
+
+    LedPattern(std::vector<LedStep> steps, uint32_t repeat = 1) : steps_(std::move(steps)), repeat_(repeat)
+    {
+    }
+
+    // count times on and off for duration_ms each, like Led::blink(). count 0 gives no steps.
+    static LedPattern blink(uint32_t duration_ms = 500, uint32_t count = 1);
+    // Double flash once per second, repeats until stopped
+    static LedPattern heartbeat();
+    // ... --- ... in Morse code, dot length dot_ms
+    static LedPattern sos(uint32_t repeat = 1, uint16_t dot_ms = 150);
+
+    const std::vector<LedStep> &steps() const { return steps_; }
+    uint32_t repeat() const { return repeat_; }
+};
+
+/**
+ * @brief Plays LED patterns in the background
+ *
+ * A single one-shot esp_timer serves all LEDs: it is always armed for the next step due on
+ * any of them, so no task blocks and the cost per LED is one list entry. Starting a pattern
+ * on an LED replaces the one playing there. When a pattern ends or is stopped, the LED
+ * returns to the state it had before the first pattern was started.
+ *
+ * The LEDs are switched from the esp_timer task. Do not call turn_on() / turn_off() on an
+ * LED while a pattern plays on it.
+ */
+class LedPatternEngine
+{
+public:
+    static LedPatternEngine &getInstance()
+    {
+        static LedPatternEngine instance;
+        return instance;
+    }
+
+    LedPatternEngine(const LedPatternEngine &) = delete;
+    LedPatternEngine &operator=(const LedPatternEngine &) = delete;
+
+    // Returns immediately, ESP_ERR_INVALID_ARG for a pattern without steps or an endless
+    // one whose steps are all 0 ms
+    esp_err_t play(Led &led, const LedPattern &pattern);
+    void stop(Led &led);
+    bool is_playing(const Led &led);
+
+    // For other LED types: id identifies the LED, set switches it
+    esp_err_t play(const void *id, std::function<void(bool)> set, bool initial_on, const LedPattern &pattern);
+    // restore = false drops the entry without touching the LED, e.g. from its destructor
+    void stop(const void *id, bool restore = true);
+    bool is_playing(const void *id);
+
+private:
+    struct Channel
+    {
+        const void *id;
+        std::function<void(bool)> set;
+        std::vector<LedStep> steps;
+        uint32_t repeat;
+        bool restore_on; // state before the pattern
+        size_t step;
+        uint32_t loops;  // completed passes through steps
+        int64_t due_us;  // end of the current step
+    };
+
+    static constexpr const char *TAG = "LedPattern";
+
+    LedPatternEngine() : timer_(nullptr) {}
+
+    esp_err_t create_timer_locked();
+    void schedule_locked(int64_t now_us);
+    static void timer_cb(void *arg);
+
+    std::vector<Channel> channels_;
+    esp_timer_handle_t timer_;
+    std::mutex mutex_;
+};
+
+} // namespace hvo
+
+#endif // LED_PATTERN_HPP
@@ -0,0 +1,121 @@
+#ifndef PWM_LED_HPP
+#define PWM_LED_HPP
+
+#include <stdint.h>
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+
+#include "driver/ledc.h"
+#include "esp_timer.h"
+#include "led.hpp"
+
+namespace hvo {
+
+static constexpr ledc_timer_bit_t PWM_LED_RESOLUTION = LEDC_TIMER_13_BIT;
+static constexpr uint32_t PWM_LED_MAX_DUTY = (1u << PWM_LED_RESOLUTION) - 1;
+
+namespace detail {
+
+// CIE 1931 lightness to luminance: level 0..255 is perceived brightness, the result the duty
+constexpr uint16_t cie1931_duty(size_t level)
+{
+    double l = level * 100.0 / 255.0;
+    double y = l <= 8.0 ? l / 903.3 : ((l + 16.0) / 116.0) * ((l + 16.0) / 116.0) * ((l + 16.0) / 116.0);
+    return static_cast<uint16_t>(y * PWM_LED_MAX_DUTY + 0.5);
+}
+
+template <size_t... I>
+constexpr std::array<uint16_t, sizeof...(I)> make_gamma_lut(std::index_sequence<I...>)
+{
+    return {{cie1931_duty(I)...}};
+}
+
+} // namespace detail
+
+// Duty per brightness level, built by the compiler
+inline constexpr std::array<uint16_t, 256> PWM_LED_GAMMA = detail::make_gamma_lut(std::make_index_sequence<256>{});
+static_assert(PWM_LED_GAMMA[0] == 0 && PWM_LED_GAMMA[255] == PWM_LED_MAX_DUTY, "gamma table must span the duty range");
+
+/**
+ * @brief LED on an LEDC channel with brightness and hardware fades
+ *
+ * Same turn_on() / turn_off() / state() interface as Led. Brightness levels are perceived
+ * brightness (0-255) and mapped to the duty through PWM_LED_GAMMA. Fades run in the LEDC
+ * peripheral without CPU load; breathe() only needs one timer callback per half period to
+ * reverse the direction.
+ *
+ * Several PwmLed may share an LEDC timer if they use the same frequency, each needs its own
+ * channel.
+ */
+class PwmLed
+{
+    gpio_num_t pin_;
+    ledc_channel_t channel_;
+    ledc_timer_t timer_;
+    led_state_t led_state_;
+    uint8_t brightness_; // level of turn_on()
+    uint8_t level_;      // current or fade target level
+    esp_timer_handle_t breathe_timer_;
+    uint8_t breathe_low_;
+    uint8_t breathe_high_;
+    uint32_t breathe_half_ms_;
+    bool breathe_up_;
+    bool breathing_; // checked by the timer callback, which may already run when the timer is stopped
+    std::mutex mutex_;
+    static constexpr const char *TAG = "PwmLed";
+
+    // Called with mutex_ held
+    esp_err_t set_level(uint8_t level);
+    void stop_breathing();
+    void breathe_step_locked();
+    static void breathe_timer_cb(void *arg);
+
+public:
+    PwmLed(uint32_t pin, ledc_channel_t channel, bool is_active_high = true, ledc_timer_t timer = LEDC_TIMER_0,
+           uint32_t freq_hz = 5000);
+    ~PwmLed();
+
+    PwmLed(const PwmLed &) = delete;
+    PwmLed &operator=(const PwmLed &) = delete;
+
+    // At the brightness set with set_brightness(), full brightness by default
+    void turn_on();
+    void turn_off();
+
+    LedState state()
+    {
+        return led_state_;
+    }
+
+    const char *state_str()
+    {
+        switch (led_state_)
+        {
+        case LedState::on:
+            return "ON";
+        case LedState::off:
+            return "OFF";
+        default:
+            return "UNKNOWN";
+        }
+    }
+
+    // Perceived brightness 0-255, applied at once while on. 0 turns the LED off.
+    esp_err_t set_brightness(uint8_t level);
+    uint8_t brightness() const { return brightness_; }
+    // Hardware fade to level within ms, returns immediately. Level 0 counts as off.
+    esp_err_t fade_to(uint8_t level, uint32_t ms);
+    // Fades between low and high until turn_on(), turn_off(), set_brightness() or fade_to()
+    esp_err_t breathe(uint32_t period_ms = 3000, uint8_t low = 0, uint8_t high = 255);
+
+    // On/off patterns through LedPatternEngine, as with Led
+    esp_err_t play(const LedPattern &pattern);
+    void stop_pattern();
+};
+
+} // namespace hvo
+
+#endif // PWM_LED_HPP
@@ -12,3 +12,24 @@ void hvo::Led::blink(uint32_t duration_ms, uint32_t count)
         vTaskDelay(pdMS_TO_TICKS(duration_ms));
     }
 }
+
+esp_err_t hvo::Led::blink_async(uint32_t duration_ms, uint32_t count)
+{
+    return play(LedPattern::blink(duration_ms, count));
+}
+
+esp_err_t hvo::Led::play(const LedPattern &pattern)
+{
+    return LedPatternEngine::getInstance().play(*this, pattern);
+}
+
+void hvo::Led::stop_pattern()
+{
+    LedPatternEngine::getInstance().stop(*this);
+}
+
+hvo::Led::~Led()
+{
+    // The engine must not switch a destroyed LED
+    LedPatternEngine::getInstance().stop(this, false);
+}
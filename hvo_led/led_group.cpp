@@ -0,0 +1,83 @@
+#include "led_group.hpp"
+#include "soc/gpio_reg.h"
+#include "soc/soc_caps.h"
+#include "soc/soc.h"
+
+namespace hvo {
+
+#if SOC_GPIO_PIN_COUNT > 32
+static constexpr size_t GPIO_BANKS = 2;
+#else
+static constexpr size_t GPIO_BANKS = 1;
+#endif
+
+LedGroup::LedGroup(std::initializer_list<Led *> leds) : pattern_(0)
+{
+    for (Led *led : leds)
+    {
+        if (led)
+            add(*led);
+    }
+}
+
+bool LedGroup::add(Led &led)
+{
+    if (leds_.size() >= LED_GROUP_MAX)
+    {
+        return false;
+    }
+    leds_.push_back(&led);
+    if (led.state() == LedState::on)
+    {
+        pattern_ |= 1u << (leds_.size() - 1);
+    }
+    return true;
+}
+
+void LedGroup::set(uint32_t pattern)
+{
+    uint32_t high[GPIO_BANKS] = {};
+    uint32_t low[GPIO_BANKS] = {};
+    for (size_t i = 0; i < leds_.size(); i++)
+    {
+        Led *led = leds_[i];
+        bool on = pattern & (1u << i);
+        size_t bank = led->pin_ / 32;
+        uint32_t bit = 1u << (led->pin_ % 32);
+        if (on == led->is_active_high_)
+            high[bank] |= bit;
+        else
+            low[bank] |= bit;
+        led->led_state_ = on ? LedState::on : LedState::off;
+    }
+
+    // One write per register and bank; unused masks are skipped
+    if (high[0])
+        REG_WRITE(GPIO_OUT_W1TS_REG, high[0]);
+    if (low[0])
+        REG_WRITE(GPIO_OUT_W1TC_REG, low[0]);
+#if SOC_GPIO_PIN_COUNT > 32
+    if (high[1])
+        REG_WRITE(GPIO_OUT1_W1TS_REG, high[1]);
+    if (low[1])
+        REG_WRITE(GPIO_OUT1_W1TC_REG, low[1]);
+#endif
+    pattern_ = pattern & (leds_.size() < 32 ? (1u << leds_.size()) - 1 : UINT32_MAX);
+}
+
+void LedGroup::all_on()
+{
+    set(UINT32_MAX);
+}
+
+void LedGroup::all_off()
+{
+    set(0);
+}
+
+void LedGroup::bar(size_t count)
+{
+    set(count >= 32 ? UINT32_MAX : (1u << count) - 1);
+}
+
+} // namespace hvo
@@ -0,0 +1,197 @@
+#include "led_pattern.hpp"
+#include "led.hpp"
+#include "esp_log.h"
+
+#include <algorithm>
+
+namespace hvo {
+
+LedPattern LedPattern::blink(uint32_t duration_ms, uint32_t count)
+{
+    if (count == 0)
+    {
+        // Nothing to blink, like Led::blink(); repeat 0 would blink forever
+        return LedPattern(std::vector<LedStep>{}, 1);
+    }
+    uint16_t ms = static_cast<uint16_t>(std::min<uint32_t>(duration_ms, UINT16_MAX));
+    return LedPattern({{true, ms}, {false, ms}}, count);
+}
+
+LedPattern LedPattern::heartbeat()
+{
+    return LedPattern({{true, 100}, {false, 100}, {true, 100}, {false, 700}}, 0);
+}
+
+LedPattern LedPattern::sos(uint32_t repeat, uint16_t dot_ms)
+{
+    // Dash and letter gap are three dots, the gap between words seven
+    const uint16_t dot = dot_ms;
+    const uint16_t dash = 3 * dot_ms;
+    std::vector<LedStep> steps;
+    for (uint16_t len : {dot, dot, dot, dash, dash, dash, dot, dot, dot})
+    {
+        steps.push_back({true, len});
+        steps.push_back({false, dot});
+    }
+    steps[5].ms = dash;  // after the first S
+    steps[11].ms = dash; // after the O
+    steps.back().ms = 7 * dot_ms;
+    return LedPattern(std::move(steps), repeat);
+}
+
+esp_err_t LedPatternEngine::play(Led &led, const LedPattern &pattern)
+{
+    Led *p = &led;
+    return play(
+        p,
+        [p](bool on)
+        {
+            if (on)
+                p->turn_on();
+            else
+                p->turn_off();
+        },
+        led.state() == LedState::on, pattern);
+}
+
+void LedPatternEngine::stop(Led &led)
+{
+    stop(&led, true);
+}
+
+bool LedPatternEngine::is_playing(const Led &led)
+{
+    return is_playing(static_cast<const void *>(&led));
+}
+
+esp_err_t LedPatternEngine::create_timer_locked()
+{
+    if (timer_)
+    {
+        return ESP_OK;
+    }
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = &timer_cb;
+    timer_args.arg = this;
+    timer_args.name = "led_pattern";
+    esp_err_t err = esp_timer_create(&timer_args, &timer_);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to create timer: %s", esp_err_to_name(err));
+        timer_ = nullptr;
+    }
+    return err;
+}
+
+esp_err_t LedPatternEngine::play(const void *id, std::function<void(bool)> set, bool initial_on,
+                                 const LedPattern &pattern)
+{
+    if (pattern.steps().empty())
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Endless steps of 0 ms would keep the timer firing back to back
+    if (pattern.repeat() == 0 &&
+        std::all_of(pattern.steps().begin(), pattern.steps().end(), [](const LedStep &s) { return s.ms == 0; }))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    esp_err_t err = create_timer_locked();
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    int64_t now = esp_timer_get_time();
+    auto it = std::find_if(channels_.begin(), channels_.end(), [id](const Channel &c) { return c.id == id; });
+    if (it == channels_.end())
+    {
+        channels_.push_back({});
+        it = channels_.end() - 1;
+        it->restore_on = initial_on;
+    }
+    // A replaced pattern keeps the state from before the first one
+    it->id = id;
+    it->set = std::move(set);
+    it->steps = pattern.steps();
+    it->repeat = pattern.repeat();
+    it->step = 0;
+    it->loops = 0;
+    it->due_us = now + it->steps[0].ms * 1000LL;
+    it->set(it->steps[0].on);
+
+    schedule_locked(now);
+    return ESP_OK;
+}
+
+void LedPatternEngine::stop(const void *id, bool restore)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = std::find_if(channels_.begin(), channels_.end(), [id](const Channel &c) { return c.id == id; });
+    if (it == channels_.end())
+    {
+        return;
+    }
+    if (restore)
+    {
+        it->set(it->restore_on);
+    }
+    channels_.erase(it);
+    schedule_locked(esp_timer_get_time());
+}
+
+bool LedPatternEngine::is_playing(const void *id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return std::any_of(channels_.begin(), channels_.end(), [id](const Channel &c) { return c.id == id; });
+}
+
+void LedPatternEngine::schedule_locked(int64_t now_us)
+{
+    esp_timer_stop(timer_);
+    if (channels_.empty())
+    {
+        return;
+    }
+    int64_t next = channels_[0].due_us;
+    for (const Channel &c : channels_)
+    {
+        next = std::min(next, c.due_us);
+    }
+    esp_timer_start_once(timer_, next > now_us ? next - now_us : 1);
+}
+
+void LedPatternEngine::timer_cb(void *arg)
+{
+    auto *engine = static_cast<LedPatternEngine *>(arg);
+    std::lock_guard<std::mutex> lock(engine->mutex_);
+    int64_t now = esp_timer_get_time();
+
+    for (auto it = engine->channels_.begin(); it != engine->channels_.end();)
+    {
+        if (it->due_us > now)
+        {
+            ++it;
+            continue;
+        }
+        if (++it->step == it->steps.size())
+        {
+            it->step = 0;
+            if (it->repeat != 0 && ++it->loops >= it->repeat)
+            {
+                it->set(it->restore_on);
+                it = engine->channels_.erase(it);
+                continue;
+            }
+        }
+        it->set(it->steps[it->step].on);
+        // Step ends are counted from the previous one, so a late callback does not stretch the pattern
+        it->due_us = std::max<int64_t>(it->due_us + it->steps[it->step].ms * 1000LL, now);
+        ++it;
+    }
+    engine->schedule_locked(now);
+}
+
+} // namespace hvo
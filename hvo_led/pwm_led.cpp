@@ -0,0 +1,265 @@
+#include "pwm_led.hpp"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <cstring>
+
+namespace hvo {
+
+// The fade service is shared by all channels and installed once
+static esp_err_t install_fade()
+{
+    static std::once_flag once;
+    static esp_err_t result = ESP_OK;
+    std::call_once(once, []
+                   {
+        result = ledc_fade_func_install(0);
+        if (result == ESP_ERR_INVALID_STATE)
+        {
+            // Installed by someone else
+            result = ESP_OK;
+        } });
+    return result;
+}
+
+static void timer_fence_cb(void *arg)
+{
+    xSemaphoreGive(static_cast<SemaphoreHandle_t>(arg));
+}
+
+// esp_timer runs callbacks one after another in its task, so once a callback queued now has
+// run, every callback dispatched before it has returned
+static bool wait_timer_callbacks()
+{
+    if (strcmp(pcTaskGetName(nullptr), "esp_timer") == 0)
+    {
+        // Called from a callback, no other callback can run at the same time
+        return true;
+    }
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    esp_timer_handle_t fence = nullptr;
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = &timer_fence_cb;
+    timer_args.arg = done;
+    timer_args.name = "pwm_led_fence";
+    bool waited = false;
+    if (done && esp_timer_create(&timer_args, &fence) == ESP_OK && esp_timer_start_once(fence, 1) == ESP_OK)
+    {
+        waited = xSemaphoreTake(done, portMAX_DELAY) == pdTRUE;
+    }
+    if (fence)
+    {
+        esp_timer_delete(fence);
+    }
+    if (done)
+    {
+        vSemaphoreDelete(done);
+    }
+    return waited;
+}
+
+PwmLed::PwmLed(uint32_t pin, ledc_channel_t channel, bool is_active_high, ledc_timer_t timer, uint32_t freq_hz)
+    : pin_(static_cast<gpio_num_t>(pin)), channel_(channel), timer_(timer), led_state_(LedState::off), brightness_(255),
+      level_(0), breathe_timer_(nullptr), breathe_low_(0), breathe_high_(255), breathe_half_ms_(0), breathe_up_(true),
+      breathing_(false)
+{
+    ledc_timer_config_t timer_config = {};
+    timer_config.speed_mode = LEDC_LOW_SPEED_MODE;
+    timer_config.duty_resolution = PWM_LED_RESOLUTION;
+    timer_config.timer_num = timer_;
+    timer_config.freq_hz = freq_hz;
+    timer_config.clk_cfg = LEDC_AUTO_CLK;
+    esp_err_t err = ledc_timer_config(&timer_config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "LEDC timer config failed: %s", esp_err_to_name(err));
+    }
+
+    ledc_channel_config_t channel_config = {};
+    channel_config.gpio_num = pin_;
+    channel_config.speed_mode = LEDC_LOW_SPEED_MODE;
+    channel_config.channel = channel_;
+    channel_config.timer_sel = timer_;
+    channel_config.duty = 0;
+    channel_config.hpoint = 0;
+    // Polarity is handled by the GPIO matrix, duty 0 is always off
+    channel_config.flags.output_invert = is_active_high ? 0 : 1;
+    err = ledc_channel_config(&channel_config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "LEDC channel config failed: %s", esp_err_to_name(err));
+    }
+
+    err = install_fade();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "LEDC fade install failed: %s", esp_err_to_name(err));
+    }
+}
+
+PwmLed::~PwmLed()
+{
+    LedPatternEngine::getInstance().stop(this, false);
+    if (breathe_timer_)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_breathing();
+        }
+        // A callback dispatched before the stop may still wait for mutex_ and must return
+        // before the object is gone
+        if (!wait_timer_callbacks())
+        {
+            ESP_LOGE(TAG, "Cannot wait for the breathe callback");
+        }
+        esp_timer_delete(breathe_timer_);
+    }
+    ledc_fade_stop(LEDC_LOW_SPEED_MODE, channel_);
+    ledc_stop(LEDC_LOW_SPEED_MODE, channel_, 0);
+}
+
+esp_err_t PwmLed::set_level(uint8_t level)
+{
+    ledc_fade_stop(LEDC_LOW_SPEED_MODE, channel_);
+    level_ = level;
+    led_state_ = level > 0 ? LedState::on : LedState::off;
+    return ledc_set_duty_and_update(LEDC_LOW_SPEED_MODE, channel_, PWM_LED_GAMMA[level], 0);
+}
+
+void PwmLed::stop_breathing()
+{
+    breathing_ = false;
+    if (breathe_timer_)
+    {
+        esp_timer_stop(breathe_timer_);
+    }
+}
+
+void PwmLed::turn_on()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_breathing();
+    // Brightness 0 stays off
+    set_level(brightness_);
+}
+
+void PwmLed::turn_off()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_breathing();
+    set_level(0);
+}
+
+esp_err_t PwmLed::set_brightness(uint8_t level)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    brightness_ = level;
+    if (led_state_ != LedState::on)
+    {
+        return ESP_OK;
+    }
+    stop_breathing();
+    return set_level(level);
+}
+
+esp_err_t PwmLed::fade_to(uint8_t level, uint32_t ms)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_breathing();
+    ledc_fade_stop(LEDC_LOW_SPEED_MODE, channel_);
+    esp_err_t err = ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, channel_, PWM_LED_GAMMA[level], ms);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    level_ = level;
+    led_state_ = level > 0 ? LedState::on : LedState::off;
+    if (level > 0)
+    {
+        brightness_ = level;
+    }
+    return ledc_fade_start(LEDC_LOW_SPEED_MODE, channel_, LEDC_FADE_NO_WAIT);
+}
+
+esp_err_t PwmLed::breathe(uint32_t period_ms, uint8_t low, uint8_t high)
+{
+    if (low >= high || period_ms < 2)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!breathe_timer_)
+    {
+        esp_timer_create_args_t timer_args = {};
+        timer_args.callback = &breathe_timer_cb;
+        timer_args.arg = this;
+        timer_args.name = "pwm_led_breathe";
+        esp_err_t err = esp_timer_create(&timer_args, &breathe_timer_);
+        if (err != ESP_OK)
+        {
+            breathe_timer_ = nullptr;
+            return err;
+        }
+    }
+    esp_timer_stop(breathe_timer_);
+    breathe_low_ = low;
+    breathe_high_ = high;
+    breathe_half_ms_ = period_ms / 2;
+
+    // Start from the current level towards the nearer end
+    set_level(level_ < low ? low : level_ > high ? high : level_);
+    breathe_up_ = level_ - low < high - level_;
+    breathing_ = true;
+    breathe_step_locked();
+    return esp_timer_start_periodic(breathe_timer_, static_cast<uint64_t>(breathe_half_ms_) * 1000);
+}
+
+void PwmLed::breathe_step_locked()
+{
+    uint8_t target = breathe_up_ ? breathe_high_ : breathe_low_;
+    ledc_fade_stop(LEDC_LOW_SPEED_MODE, channel_);
+    if (ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, channel_, PWM_LED_GAMMA[target], breathe_half_ms_) == ESP_OK)
+    {
+        ledc_fade_start(LEDC_LOW_SPEED_MODE, channel_, LEDC_FADE_NO_WAIT);
+    }
+    level_ = target;
+    led_state_ = LedState::on;
+    breathe_up_ = !breathe_up_;
+}
+
+void PwmLed::breathe_timer_cb(void *arg)
+{
+    auto *led = static_cast<PwmLed *>(arg);
+    std::lock_guard<std::mutex> lock(led->mutex_);
+    // Stopping the timer does not cancel a callback that is already waiting for the lock
+    if (led->breathing_)
+    {
+        led->breathe_step_locked();
+    }
+}
+
+esp_err_t PwmLed::play(const LedPattern &pattern)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_breathing();
+    }
+    return LedPatternEngine::getInstance().play(
+        this,
+        [this](bool on)
+        {
+            if (on)
+                turn_on();
+            else
+                turn_off();
+        },
+        led_state_ == LedState::on, pattern);
+}
+
+void PwmLed::stop_pattern()
+{
+    LedPatternEngine::getInstance().stop(this);
+}
+
+} // namespace hvo
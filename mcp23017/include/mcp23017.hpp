@@ -81,6 +81,13 @@ public:
     esp_err_t readPortB(uint8_t &value);
     esp_err_t setPullUpA(uint8_t pullup);
     esp_err_t setPullUpB(uint8_t pullup);
+    esp_err_t readPullUpA(uint8_t &pullup);
+    esp_err_t readPullUpB(uint8_t &pullup);
+    // GPIOA in the low byte, GPIOB in the high byte, read in one I2C transaction
+    esp_err_t readPorts(uint16_t &value);
+    // Interrupt-on-change for the pins in mask (GPA low byte, GPB high byte). INTA and INTB
+    // are mirrored and open drain, active low; reading the ports clears the interrupt.
+    esp_err_t setInterruptOnChange(uint16_t mask);
 
     esp_err_t setPin(McpBank bank, uint8_t pin, PinLevel level);
     esp_err_t setPinDirection(McpBank bank, uint8_t pin, PinDirection direction);
@@ -91,6 +98,8 @@ public:
 
 private:
     static constexpr const char *TAG_ = "MCP23017";
+    static constexpr uint8_t IOCON_MIRROR = 0x40; // INTA and INTB internally connected
+    static constexpr uint8_t IOCON_ODR = 0x04;    // open-drain interrupt outputs
 
     MCP23017();
     ~MCP23017();
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "mcp23017.hpp"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Key state change reported by McpKeypad
+ *
+ * row and col are the MCP23017 pin numbers (0-7) on the row and column bank.
+ */
+struct McpKeyEvent
+{
+    uint8_t row;
+    uint8_t col;
+    bool pressed;
+    int64_t timestamp_us; // esp_timer time when the debounced state changed
+};
+
+/**
+ * @brief Keypad matrix layout and scan timing
+ *
+ * Rows are outputs on row_bank, columns are inputs with pull-ups on the other bank.
+ * A key connects its row to its column; pressed keys read low while their row is driven low.
+ * Use a diode per key for true n-key rollover.
+ */
+struct McpKeypadConfig
+{
+    McpBank row_bank = McpBank::GPA;
+    uint8_t row_mask = 0x0F;
+    uint8_t col_mask = 0x0F;
+    uint32_t scan_period_ms = CONFIG_HV_MCP23017_KEYPAD_SCAN_MS;
+    uint32_t idle_period_ms = CONFIG_HV_MCP23017_KEYPAD_IDLE_SCAN_MS;
+    uint8_t debounce_scans = CONFIG_HV_MCP23017_KEYPAD_DEBOUNCE_SCANS;
+    uint32_t queue_length = CONFIG_HV_MCP23017_KEYPAD_QUEUE_LEN;
+    UBaseType_t task_priority = CONFIG_HV_MCP23017_KEYPAD_TASK_PRIORITY;
+    uint32_t task_stack_size = CONFIG_HV_MCP23017_KEYPAD_TASK_STACK_SIZE;
+};
+
+/**
+ * @brief Debounced keypad matrix scanner on top of the MCP23017 singleton
+ *
+ * A full scan costs one port write plus one port read per row. While no key is down
+ * all rows are held low and each idle tick is a single column read.
+ */
+class McpKeypad
+{
+public:
+    explicit McpKeypad(const McpKeypadConfig &config = McpKeypadConfig());
+    ~McpKeypad();
+
+    McpKeypad(const McpKeypad &) = delete;
+    McpKeypad &operator=(const McpKeypad &) = delete;
+
+    // Configures pin directions and pull-ups and starts the scan task.
+    // MCP23017::init() must have been called before.
+    esp_err_t start();
+    void stop();
+
+    // Queue of McpKeyEvent, created by start()
+    QueueHandle_t getQueue() const { return queue_; }
+
+    bool isPressed(uint8_t row, uint8_t col) const;
+    // bit (row * 8 + col) is set for every debounced pressed key
+    uint64_t getPressedMask() const { return pressed_.load(); }
+
+private:
+    static constexpr const char *TAG_ = "McpKeypad";
+
+    static void scanTask(void *arg);
+
+    esp_err_t configurePins();
+    esp_err_t writeRows(uint8_t value);
+    esp_err_t readCols(uint8_t &value);
+    // Returns true while any key is down or still bouncing
+    bool scan();
+    bool idleCheck();
+    void debounce(uint8_t row, uint8_t raw_cols);
+
+    McpKeypadConfig config_;
+    // Periods in whole ticks, at least one: pdMS_TO_TICKS(5) is 0 at 100 Hz
+    TickType_t scan_ticks_;
+    TickType_t idle_ticks_;
+    QueueHandle_t queue_;
+    TaskHandle_t task_;
+    TaskHandle_t stop_waiter_;
+    std::atomic<bool> running_;
+    std::atomic<uint64_t> pressed_;
+    uint8_t row_latch_;  // row bank output latch with all rows released
+    bool rows_parked_;   // all rows driven low for idle detection
+    std::array<uint8_t, 64> integrators_;
+};
@@ -140,6 +140,54 @@ esp_err_t MCP23017::setPullUpB(uint8_t pullup)
     return writeRegister(Register::GPPUB, pullup);
 }
 
+esp_err_t MCP23017::readPullUpA(uint8_t &pullup)
+{
+    return readRegister(Register::GPPUA, &pullup);
+}
+
+esp_err_t MCP23017::readPullUpB(uint8_t &pullup)
+{
+    return readRegister(Register::GPPUB, &pullup);
+}
+
+esp_err_t MCP23017::readPorts(uint16_t &value)
+{
+    if (!initialized_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    // With IOCON.BANK = 0 the register address increments from GPIOA to GPIOB
+    uint8_t data[2];
+    esp_err_t err = I2c::getInstance().receive(dev_handle_, static_cast<uint8_t>(Register::GPIOA), data, sizeof(data));
+    if (err == ESP_OK)
+    {
+        value = data[0] | (data[1] << 8);
+    }
+    return err;
+}
+
+esp_err_t MCP23017::setInterruptOnChange(uint16_t mask)
+{
+    uint8_t iocon;
+    esp_err_t err = readRegister(Register::IOCON, &iocon);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    iocon |= IOCON_MIRROR | IOCON_ODR;
+    err = writeRegister(Register::IOCON, iocon);
+    // Compare against the previous pin value, so every change raises the interrupt
+    if (err == ESP_OK)
+        err = writeRegister(Register::INTCONA, 0x00);
+    if (err == ESP_OK)
+        err = writeRegister(Register::INTCONB, 0x00);
+    if (err == ESP_OK)
+        err = writeRegister(Register::GPINTENA, mask & 0xFF);
+    if (err == ESP_OK)
+        err = writeRegister(Register::GPINTENB, mask >> 8);
+    return err;
+}
+
 esp_err_t MCP23017::setPin(McpBank bank, uint8_t pin, PinLevel level)
 {
     if (pin > 7)
@@ -0,0 +1,315 @@
+#include "mcp_keypad.hpp"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+// Rounded up, so the debounce time is never shorter than configured
+static TickType_t ms_to_ticks(uint32_t ms)
+{
+    TickType_t ticks = (static_cast<uint64_t>(ms) * configTICK_RATE_HZ + 999) / 1000;
+    return ticks > 0 ? ticks : 1;
+}
+
+McpKeypad::McpKeypad(const McpKeypadConfig &config)
+    : config_(config), queue_(nullptr), task_(nullptr), stop_waiter_(nullptr), running_(false), pressed_(0),
+      row_latch_(0xFF), rows_parked_(false), integrators_{}
+{
+    if (config_.debounce_scans == 0)
+    {
+        config_.debounce_scans = 1;
+    }
+    scan_ticks_ = ms_to_ticks(config_.scan_period_ms);
+    idle_ticks_ = ms_to_ticks(config_.idle_period_ms);
+}
+
+McpKeypad::~McpKeypad()
+{
+    stop();
+    if (queue_)
+    {
+        vQueueDelete(queue_);
+    }
+}
+
+esp_err_t McpKeypad::start()
+{
+    if (running_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!MCP23017::getInstance().isInitialized())
+    {
+        ESP_LOGE(TAG_, "MCP23017 not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config_.row_mask == 0 || config_.col_mask == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t err = configurePins();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG_, "Failed to configure keypad pins: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    if (!queue_)
+    {
+        queue_ = xQueueCreate(config_.queue_length, sizeof(McpKeyEvent));
+        if (!queue_)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    running_ = true;
+    if (xTaskCreate(scanTask, "mcp_keypad", config_.task_stack_size, this, config_.task_priority, &task_) != pdPASS)
+    {
+        running_ = false;
+        task_ = nullptr;
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_LOGI(TAG_, "Keypad scan started (rows 0x%02X, cols 0x%02X)", config_.row_mask, config_.col_mask);
+    return ESP_OK;
+}
+
+void McpKeypad::stop()
+{
+    if (!task_)
+    {
+        return;
+    }
+    // The scan task notifies us once it left the loop, so it never dies holding the MCP23017 mutex
+    stop_waiter_ = xTaskGetCurrentTaskHandle();
+    running_ = false;
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    task_ = nullptr;
+}
+
+bool McpKeypad::isPressed(uint8_t row, uint8_t col) const
+{
+    if (row > 7 || col > 7)
+    {
+        return false;
+    }
+    return (pressed_.load() >> (row * 8 + col)) & 1;
+}
+
+esp_err_t McpKeypad::configurePins()
+{
+    auto &mcp = MCP23017::getInstance();
+    auto lock = mcp.lock(std::chrono::milliseconds(100));
+    if (!lock)
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    uint8_t row_dir;
+    uint8_t col_dir;
+    esp_err_t err;
+    if (config_.row_bank == McpBank::GPA)
+    {
+        err = mcp.readPortADirection(row_dir);
+        if (err == ESP_OK)
+            err = mcp.readPortBDirection(col_dir);
+        if (err == ESP_OK)
+            err = mcp.readPortA(row_latch_);
+    }
+    else
+    {
+        err = mcp.readPortBDirection(row_dir);
+        if (err == ESP_OK)
+            err = mcp.readPortADirection(col_dir);
+        if (err == ESP_OK)
+            err = mcp.readPortB(row_latch_);
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    // Released rows idle high, other pins on the row bank keep their current level
+    row_latch_ |= config_.row_mask;
+    rows_parked_ = false;
+    err = writeRows(row_latch_);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    row_dir &= ~config_.row_mask;
+    col_dir |= config_.col_mask;
+    // Other pins on the column bank, e.g. McpButtonPort inputs, keep their pull-up
+    uint8_t col_pullup;
+    if (config_.row_bank == McpBank::GPA)
+    {
+        err = mcp.setPortADirection(row_dir);
+        if (err == ESP_OK)
+            err = mcp.setPortBDirection(col_dir);
+        if (err == ESP_OK)
+            err = mcp.readPullUpB(col_pullup);
+        if (err == ESP_OK)
+            err = mcp.setPullUpB(col_pullup | config_.col_mask);
+    }
+    else
+    {
+        err = mcp.setPortBDirection(row_dir);
+        if (err == ESP_OK)
+            err = mcp.setPortADirection(col_dir);
+        if (err == ESP_OK)
+            err = mcp.readPullUpA(col_pullup);
+        if (err == ESP_OK)
+            err = mcp.setPullUpA(col_pullup | config_.col_mask);
+    }
+    return err;
+}
+
+esp_err_t McpKeypad::writeRows(uint8_t value)
+{
+    auto &mcp = MCP23017::getInstance();
+    return config_.row_bank == McpBank::GPA ? mcp.writePortA(value) : mcp.writePortB(value);
+}
+
+esp_err_t McpKeypad::readCols(uint8_t &value)
+{
+    auto &mcp = MCP23017::getInstance();
+    return config_.row_bank == McpBank::GPA ? mcp.readPortB(value) : mcp.readPortA(value);
+}
+
+bool McpKeypad::idleCheck()
+{
+    auto lock = MCP23017::getInstance().lock(std::chrono::milliseconds(config_.idle_period_ms));
+    if (!lock)
+    {
+        return false;
+    }
+
+    // Drive all rows low once, then any key press pulls its column low
+    if (!rows_parked_)
+    {
+        if (writeRows(row_latch_ & ~config_.row_mask) != ESP_OK)
+        {
+            return false;
+        }
+        rows_parked_ = true;
+    }
+
+    uint8_t cols;
+    if (readCols(cols) != ESP_OK)
+    {
+        return false;
+    }
+    return (~cols & config_.col_mask) != 0;
+}
+
+bool McpKeypad::scan()
+{
+    auto lock = MCP23017::getInstance().lock(std::chrono::milliseconds(config_.scan_period_ms));
+    if (!lock)
+    {
+        // Bus busy, stay in active mode and retry on the next tick
+        return true;
+    }
+
+    rows_parked_ = false;
+    for (uint8_t row = 0; row < 8; row++)
+    {
+        if (!(config_.row_mask & (1 << row)))
+        {
+            continue;
+        }
+        uint8_t cols;
+        if (writeRows(row_latch_ & ~(1 << row)) != ESP_OK || readCols(cols) != ESP_OK)
+        {
+            ESP_LOGW(TAG_, "Scan of row %d failed", row);
+            return true;
+        }
+        debounce(row, ~cols & config_.col_mask);
+    }
+
+    if (pressed_.load() != 0)
+    {
+        return true;
+    }
+    for (uint8_t integrator : integrators_)
+    {
+        if (integrator != 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void McpKeypad::debounce(uint8_t row, uint8_t raw_cols)
+{
+    uint64_t pressed = pressed_.load();
+    for (uint8_t col = 0; col < 8; col++)
+    {
+        if (!(config_.col_mask & (1 << col)))
+        {
+            continue;
+        }
+
+        // Integrating debounce: the count moves one step per scan towards the raw level
+        // and the key only changes state at the limits.
+        uint8_t idx = row * 8 + col;
+        uint8_t &integrator = integrators_[idx];
+        if (raw_cols & (1 << col))
+        {
+            if (integrator < config_.debounce_scans)
+                integrator++;
+        }
+        else if (integrator > 0)
+        {
+            integrator--;
+        }
+
+        uint64_t bit = 1ULL << idx;
+        bool was_pressed = pressed & bit;
+        bool now_pressed = was_pressed;
+        if (!was_pressed && integrator == config_.debounce_scans)
+        {
+            now_pressed = true;
+            pressed |= bit;
+        }
+        else if (was_pressed && integrator == 0)
+        {
+            now_pressed = false;
+            pressed &= ~bit;
+        }
+
+        if (now_pressed != was_pressed)
+        {
+            McpKeyEvent event = {row, col, now_pressed, esp_timer_get_time()};
+            if (xQueueSend(queue_, &event, 0) != pdTRUE)
+            {
+                ESP_LOGW(TAG_, "Key event queue full, dropped event for key %d/%d", row, col);
+            }
+        }
+    }
+    pressed_.store(pressed);
+}
+
+void McpKeypad::scanTask(void *arg)
+{
+    auto *keypad = static_cast<McpKeypad *>(arg);
+    TickType_t last_wake = xTaskGetTickCount();
+    bool active = true;
+
+    while (keypad->running_)
+    {
+        if (!active)
+        {
+            active = keypad->idleCheck();
+        }
+        if (active)
+        {
+            active = keypad->scan();
+        }
+        vTaskDelayUntil(&last_wake, active ? keypad->scan_ticks_ : keypad->idle_ticks_);
+    }
+
+    xTaskNotifyGive(keypad->stop_waiter_);
+    vTaskDelete(nullptr);
+}
@@ -1,33 +1,235 @@
 #pragma once
 #include <nvs.h>
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+// Prefix of every record blob written by Nvs::write_record
+struct NvsRecordHeader
+{
+    uint16_t version;
+    uint16_t size; // payload size in bytes
+    uint32_t crc;  // CRC32 over version, size and payload
+};
+
+// Write counters of all Nvs objects since boot or the last Nvs::reset_stats()
+struct NvsStats
+{
+    uint32_t set_ops;   // nvs_set_* calls
+    uint32_t commits;   // nvs_commit calls
+    uint32_t bytes_set; // payload bytes handed to nvs_set_*
+};
+
+// Converts a record payload stored with an older schema version into the current type.
+// Return false if the old version cannot be migrated.
+template <typename T>
+using NvsMigrateFn = bool (*)(uint16_t from_version, const uint8_t *data, size_t len, T &out);
 
 class Nvs
 {
 private:
+    using CachedValue = std::variant<int32_t, std::string, std::vector<uint8_t>>;
+
     nvs_handle_t handle_;
     bool is_initialized_;
 
+    // Write-back cache, only used between begin() and commit()
+    bool write_back_;
+    std::map<std::string, CachedValue, std::less<>> pending_;
+    uint32_t commit_delay_ms_;
+    esp_timer_handle_t commit_timer_;
+    uint32_t flush_id_; // key in the idle flush registry, 0 until the timer exists
+    mutable std::mutex mutex_;
+
     Nvs(const Nvs &) = delete;
     Nvs &operator=(const Nvs &) = delete;
     Nvs(Nvs &&) = delete;
     Nvs &operator=(Nvs &&) = delete;
 
+    esp_err_t stage(std::string_view key, CachedValue v);
+    const CachedValue *find_pending(std::string_view key) const;
+    esp_err_t flush_locked();
+    void arm_commit_timer();
+    static void commit_timer_cb(void *arg);
+    static void idle_flush_task(void *arg);
+
+    // Header and payload back to back, without the tail padding a struct of both would get
+    template <typename T>
+    struct Record
+    {
+        uint8_t bytes[sizeof(NvsRecordHeader) + sizeof(T)];
+
+        uint8_t *payload() { return bytes + sizeof(NvsRecordHeader); }
+    };
+
+    static void seal_record(NvsRecordHeader &header, uint16_t version, const void *payload, size_t len);
+    static uint32_t record_crc(const NvsRecordHeader &header, const void *payload);
+    // Reads a whole record of any size and validates it
+    esp_err_t load_record(std::string_view key, std::vector<uint8_t> &raw, NvsRecordHeader &header);
+
 public:
-    Nvs() : handle_(-1), is_initialized_(false) {}
-    ~Nvs()
+    Nvs() : handle_(-1), is_initialized_(false), write_back_(false), commit_delay_ms_(CONFIG_HV_NVS_COMMIT_DELAY_MS),
+            commit_timer_(nullptr), flush_id_(0) {}
+    ~Nvs();
+
+    // Keys and namespaces are copied to a stack buffer, they never allocate.
+    // std::string and string literals convert implicitly.
+    esp_err_t open_namespace(std::string_view nvs_ns);
+    // Stored as an 8 byte record, reads fall back to int32 values written by older versions
+    esp_err_t write(std::string_view key, double v);
+    esp_err_t write(std::string_view key, int v);
+    esp_err_t write(std::string_view key, std::string_view v);
+    esp_err_t write(std::string_view key, const char *v);
+    esp_err_t write_blob(std::string_view key, const void *data, size_t len);
+    // v is left unchanged if the key does not exist
+    esp_err_t read(std::string_view key, double &v);
+    esp_err_t read(std::string_view key, int &v);
+    // Sizes the value first, then reads it with at most one allocation
+    esp_err_t read(std::string_view key, std::string &v);
+    // Reads into a caller buffer. len is the buffer size on entry and the stored length
+    // including the terminating NUL on return. With buf == nullptr only the length is returned.
+    esp_err_t read(std::string_view key, char *buf, size_t &len);
+    esp_err_t read_blob(std::string_view key, std::vector<uint8_t> &v);
+    // Same size-query contract as read(key, buf, len)
+    esp_err_t read_blob(std::string_view key, void *buf, size_t &len);
+
+    // Remove one key / every key of the namespace, including staged writes
+    esp_err_t erase_key(std::string_view key);
+    esp_err_t erase_all();
+
+    // Stores a trivially copyable value as one blob with schema version and CRC
+    template <typename T>
+    esp_err_t write_record(std::string_view key, const T &value, uint16_t version = 1)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "NVS records must be trivially copyable");
+        static_assert(sizeof(T) <= UINT16_MAX, "NVS record too large");
+
+        Record<T> rec;
+        NvsRecordHeader header;
+        memcpy(rec.payload(), &value, sizeof(T));
+        seal_record(header, version, rec.payload(), sizeof(T));
+        memcpy(rec.bytes, &header, sizeof(header));
+        return write_blob(key, rec.bytes, sizeof(rec.bytes));
+    }
+
+    // The blob write_record stores, for callers that hand it to another writer such as NvsAsyncWriter
+    template <typename T>
+    static std::vector<uint8_t> encode_record(const T &value, uint16_t version = 1)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "NVS records must be trivially copyable");
+        static_assert(sizeof(T) <= UINT16_MAX, "NVS record too large");
+
+        std::vector<uint8_t> bytes(sizeof(NvsRecordHeader) + sizeof(T));
+        NvsRecordHeader header;
+        memcpy(bytes.data() + sizeof(header), &value, sizeof(T));
+        seal_record(header, version, bytes.data() + sizeof(header), sizeof(T));
+        memcpy(bytes.data(), &header, sizeof(header));
+        return bytes;
+    }
+
+    // Loads a record with a single blob read. Records with another version are passed to
+    // migrate and written back with the current version on success.
+    template <typename T>
+    esp_err_t read_record(std::string_view key, T &value, uint16_t version = 1, NvsMigrateFn<T> migrate = nullptr)
     {
-        if (is_initialized_ && handle_ != -1)
+        static_assert(std::is_trivially_copyable_v<T>, "NVS records must be trivially copyable");
+
+        Record<T> rec;
+        NvsRecordHeader header;
+        size_t len = sizeof(rec.bytes);
+        esp_err_t ret = read_blob(key, rec.bytes, len);
+        memcpy(&header, rec.bytes, sizeof(header));
+        if (ret == ESP_OK && len == sizeof(rec.bytes) && header.version == version && header.size == sizeof(T))
         {
-            nvs_close(handle_);
+            if (record_crc(header, rec.payload()) != header.crc)
+            {
+                return ESP_ERR_INVALID_CRC;
+            }
+            memcpy(&value, rec.payload(), sizeof(T));
+            return ESP_OK;
         }
-    };
+        if (ret != ESP_OK && ret != ESP_ERR_NVS_INVALID_LENGTH)
+        {
+            return ret;
+        }
+
+        // Size or version differ from the current schema
+        std::vector<uint8_t> raw;
+        ret = load_record(key, raw, header);
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        if (header.version == version)
+        {
+            if (header.size != sizeof(T))
+            {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            // Written with tail padding by an older build, the next write drops it
+            memcpy(&value, raw.data() + sizeof(header), sizeof(T));
+            return ESP_OK;
+        }
+        if (!migrate || !migrate(header.version, raw.data() + sizeof(header), header.size, value))
+        {
+            return ESP_ERR_INVALID_VERSION;
+        }
+        return write_record(key, value, version);
+    }
+
+    // Start staging writes in RAM. Reads see staged values.
+    esp_err_t begin();
+    // Write all staged values with a single nvs_commit and leave write-back mode
+    esp_err_t commit();
+    // Drop all staged values and leave write-back mode
+    void rollback();
+    bool in_transaction() const;
+    size_t pending_count() const;
+    // True while key has a staged value, also after a commit() that failed to write it
+    bool is_pending(std::string_view key) const;
+    // Flush staged values after ms without further writes, 0 disables the idle flush
+    void set_commit_delay(uint32_t ms);
+
+    static NvsStats stats();
+    static void reset_stats();
+};
+
+// Stages all writes on nvs for the lifetime of the guard and commits them on scope exit
+class NvsTransaction
+{
+    Nvs &nvs_;
+    bool done_;
+
+public:
+    explicit NvsTransaction(Nvs &nvs) : nvs_(nvs), done_(false) { nvs_.begin(); }
+    ~NvsTransaction()
+    {
+        if (!done_)
+        {
+            nvs_.commit();
+        }
+    }
+
+    NvsTransaction(const NvsTransaction &) = delete;
+    NvsTransaction &operator=(const NvsTransaction &) = delete;
 
-    esp_err_t open_namespace(std::string);
-    esp_err_t write(std::string key, double v);
-    esp_err_t write(std::string key, int v);
-    esp_err_t write(std::string key, std::string v);
-    esp_err_t read(std::string key, double &v);
-    esp_err_t read(std::string key, int &v);
-    esp_err_t read(std::string key, std::string &v);
+    esp_err_t commit()
+    {
+        done_ = true;
+        return nvs_.commit();
+    }
+
+    void rollback()
+    {
+        done_ = true;
+        nvs_.rollback();
+    }
 };
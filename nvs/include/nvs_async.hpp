@@ -0,0 +1,91 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "nvs.hpp"
+#include "sdkconfig.h"
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+/**
+ * @brief Background persistence task for NVS writes
+ *
+ * write() only stores the value in a RAM map keyed by namespace and key and returns.
+ * A low priority task writes the collected values, one transaction and commit per
+ * namespace. A key written several times before the task runs is stored once with the
+ * newest value.
+ */
+class NvsAsyncWriter
+{
+public:
+    static NvsAsyncWriter &getInstance()
+    {
+        static NvsAsyncWriter instance;
+        return instance;
+    }
+
+    NvsAsyncWriter(const NvsAsyncWriter &) = delete;
+    NvsAsyncWriter &operator=(const NvsAsyncWriter &) = delete;
+
+    esp_err_t start(UBaseType_t priority = CONFIG_HV_NVS_ASYNC_TASK_PRIORITY,
+                    uint32_t stack_size = CONFIG_HV_NVS_ASYNC_TASK_STACK_SIZE);
+
+    esp_err_t write(std::string_view nvs_ns, std::string_view key, int v);
+    esp_err_t write(std::string_view nvs_ns, std::string_view key, double v);
+    esp_err_t write(std::string_view nvs_ns, std::string_view key, std::string_view v);
+    esp_err_t write(std::string_view nvs_ns, std::string_view key, const char *v);
+    esp_err_t write_blob(std::string_view nvs_ns, std::string_view key, const void *data, size_t len);
+    // Same blob as Nvs::write_record, read it back with Nvs::read_record
+    template <typename T>
+    esp_err_t write_record(std::string_view nvs_ns, std::string_view key, const T &value, uint16_t version = 1)
+    {
+        return post(nvs_ns, key, Nvs::encode_record(value, version));
+    }
+
+    // Fence: blocks until every write posted before the call is committed to flash.
+    // Returns the first error of those writes, ESP_ERR_TIMEOUT if timeout expired.
+    // Values that failed stay queued and are retried with backoff unless a newer value
+    // was posted; while any of them is unwritten every flush() retries once and returns
+    // the error.
+    esp_err_t flush(TickType_t timeout = portMAX_DELAY);
+
+    size_t pending() const;
+
+private:
+    using Value = std::variant<int32_t, double, std::string, std::vector<uint8_t>>;
+    using Key = std::pair<std::string, std::string>; // namespace, key
+
+    static constexpr const char *TAG = "hv-nvs-async";
+    static constexpr uint32_t RETRY_MIN_MS = 1000;
+    static constexpr uint32_t RETRY_MAX_MS = 60000;
+
+    NvsAsyncWriter()
+        : task_(nullptr), posted_gen_(0), done_gen_(0), tried_gen_(0), batches_(0), retry_ms_(0), urgent_(false),
+          last_error_(ESP_OK)
+    {
+    }
+
+    esp_err_t post(std::string_view nvs_ns, std::string_view key, Value v);
+    static void writer_task(void *arg);
+    // Leaves only the entries that could not be written in batch
+    esp_err_t write_batch(std::map<Key, Value> &batch);
+
+    TaskHandle_t task_;
+    std::map<Key, Value> pending_;
+    uint64_t posted_gen_; // incremented by every write()
+    uint64_t done_gen_;   // all writes up to this generation are on flash
+    uint64_t tried_gen_;  // all writes up to this generation were attempted at least once
+    uint64_t batches_;    // completed batches, successful or not
+    uint32_t retry_ms_;   // delay before failed values are retried, 0 when none are queued
+    bool urgent_;         // a flush() is waiting, skip the batch delay
+    esp_err_t last_error_;
+    mutable std::mutex mutex_;
+    std::condition_variable done_cv_;
+};
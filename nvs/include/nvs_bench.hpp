@@ -0,0 +1,37 @@
+#pragma once
+#include "nvs.hpp"
+#include "nvs_host.hpp"
+#include "sdkconfig.h"
+
+#if CONFIG_HV_NVS_BENCH
+
+// Result of one benchmark workload
+struct NvsBenchResult
+{
+    const char *name;
+    uint32_t ops;          // API calls measured, up to and including a failed one
+    esp_err_t err;         // first error, the workload stops there
+    uint64_t total_us;     // wall time of all calls
+    uint32_t max_us;       // slowest single call
+    NvsStats nvs;          // sets and commits issued by Nvs
+    NvsFlashStats flash;   // emulated flash activity, linux target only
+};
+
+using NvsBenchReportFn = void (*)(const NvsBenchResult &result);
+
+// Logs one result line including write amplification where flash stats are available
+void nvs_bench_print(const NvsBenchResult &result);
+
+/**
+ * @brief Runs the storage benchmark workloads in nvs_namespace
+ *
+ * Config workloads write and read 30 mixed settings as single writes, as one
+ * transaction and as one record. The logging workload appends samples to a ring
+ * of keys. The namespace is erased before and after the run.
+ *
+ * A workload stops at its first failing call and reports the error in its result;
+ * the remaining workloads still run. Returns the first error of the whole run.
+ */
+esp_err_t nvs_bench_run(const char *nvs_namespace = "nvs_bench", NvsBenchReportFn report = nvs_bench_print);
+
+#endif // CONFIG_HV_NVS_BENCH
@@ -0,0 +1,33 @@
+#pragma once
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include <cstddef>
+#include <cstdint>
+
+// Flash activity of the emulated NVS partition on the linux target
+struct NvsFlashStats
+{
+    size_t read_ops;
+    size_t write_ops;
+    size_t erase_ops;
+    size_t read_bytes;
+    size_t write_bytes;
+    uint64_t simulated_us; // estimated device flash time from the Kconfig cost model
+};
+
+#if CONFIG_IDF_TARGET_LINUX
+
+// Backs the NVS partition with the flash image image_path (mmap'd by esp_partition) and
+// initializes nvs_flash. The image survives the process, so namespaces persist between runs.
+// With erase set the NVS partition is erased first.
+esp_err_t nvs_host_init(const char *image_path, bool erase = false);
+void nvs_host_deinit();
+
+NvsFlashStats nvs_host_flash_stats();
+void nvs_host_clear_stats();
+
+// Sleeps for the modelled device flash time of all flash operations since the last call.
+// Called by Nvs after every set and commit when CONFIG_HV_NVS_HOST_SIMULATE_LATENCY is on.
+void nvs_host_simulate_latency();
+
+#endif
@@ -0,0 +1,312 @@
+#pragma once
+#include "nvs.hpp"
+#include "esp_log.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <string_view>
+
+enum class NvsType : uint8_t
+{
+    I32,
+    F64,
+    STR,
+};
+
+// One entry of a compile-time NVS namespace schema
+struct NvsField
+{
+    const char *key;
+    NvsType type;
+    int32_t default_int;
+    double default_double;
+    const char *default_str;
+    uint16_t max_len; // strings only, excluding the terminating NUL
+};
+
+constexpr NvsField nvs_int(const char *key, int32_t default_value = 0)
+{
+    return {key, NvsType::I32, default_value, 0.0, nullptr, 0};
+}
+
+constexpr NvsField nvs_double(const char *key, double default_value = 0.0)
+{
+    return {key, NvsType::F64, 0, default_value, nullptr, 0};
+}
+
+constexpr NvsField nvs_str(const char *key, uint16_t max_len, const char *default_value = "")
+{
+    return {key, NvsType::STR, 0, 0.0, default_value, max_len};
+}
+
+constexpr size_t nvs_cstr_len(const char *s)
+{
+    size_t len = 0;
+    while (s[len] != '\0')
+        len++;
+    return len;
+}
+
+constexpr bool nvs_cstr_equal(const char *a, const char *b)
+{
+    size_t i = 0;
+    for (; a[i] != '\0' && a[i] == b[i]; i++)
+    {
+    }
+    return a[i] == b[i];
+}
+
+// Bytes a field occupies in the packed NvsSchema buffer
+constexpr size_t nvs_slot_size(const NvsField &field)
+{
+    switch (field.type)
+    {
+    case NvsType::I32:
+        return sizeof(int32_t);
+    case NvsType::F64:
+        return sizeof(double);
+    default:
+        return field.max_len + 1;
+    }
+}
+
+template <size_t N>
+constexpr bool nvs_keys_valid(const NvsField (&fields)[N])
+{
+    for (size_t i = 0; i < N; i++)
+    {
+        size_t len = nvs_cstr_len(fields[i].key);
+        if (len == 0 || len >= NVS_KEY_NAME_MAX_SIZE)
+            return false;
+    }
+    return true;
+}
+
+template <size_t N>
+constexpr bool nvs_keys_unique(const NvsField (&fields)[N])
+{
+    for (size_t i = 0; i < N; i++)
+        for (size_t j = i + 1; j < N; j++)
+            if (nvs_cstr_equal(fields[i].key, fields[j].key))
+                return false;
+    return true;
+}
+
+template <size_t N>
+constexpr bool nvs_defaults_fit(const NvsField (&fields)[N])
+{
+    for (size_t i = 0; i < N; i++)
+        if (fields[i].type == NvsType::STR && nvs_cstr_len(fields[i].default_str) > fields[i].max_len)
+            return false;
+    return true;
+}
+
+/**
+ * @brief All values of one NVS namespace in a packed buffer, laid out at compile time
+ *
+ * Fields must be a constexpr NvsField array with static storage duration. Values are
+ * accessed by index with get<I>() / set<I>(), typically through an enum listing the fields:
+ *
+ *     inline constexpr NvsField kConfigFields[] = {nvs_str("wifi_ssid", 32), nvs_int("retries", 5)};
+ *     enum ConfigKey : size_t { WIFI_SSID, RETRIES };
+ *     NvsSchema<kConfigFields> config;
+ *     config.load(nvs);
+ *     std::string_view ssid = config.get<WIFI_SSID>();
+ */
+template <const auto &Fields>
+class NvsSchema
+{
+public:
+    static constexpr size_t FIELD_COUNT = std::size(Fields);
+
+private:
+    static_assert(nvs_keys_valid(Fields), "NVS keys must be 1 to 15 characters long");
+    static_assert(nvs_keys_unique(Fields), "NVS keys must be unique within a namespace");
+    static_assert(nvs_defaults_fit(Fields), "NVS string default longer than its max_len");
+
+    static constexpr std::array<size_t, FIELD_COUNT + 1> OFFSETS = []()
+    {
+        std::array<size_t, FIELD_COUNT + 1> offsets{};
+        for (size_t i = 0; i < FIELD_COUNT; i++)
+            offsets[i + 1] = offsets[i] + nvs_slot_size(Fields[i]);
+        return offsets;
+    }();
+
+    uint8_t data_[OFFSETS[FIELD_COUNT]];
+
+    static constexpr const char *TAG = "hv-nvs";
+
+public:
+    static constexpr size_t DATA_SIZE = OFFSETS[FIELD_COUNT];
+
+    NvsSchema() { reset(); }
+
+    // Sets every field to its schema default
+    void reset()
+    {
+        for (size_t i = 0; i < FIELD_COUNT; i++)
+        {
+            uint8_t *slot = data_ + OFFSETS[i];
+            switch (Fields[i].type)
+            {
+            case NvsType::I32:
+                memcpy(slot, &Fields[i].default_int, sizeof(int32_t));
+                break;
+            case NvsType::F64:
+                memcpy(slot, &Fields[i].default_double, sizeof(double));
+                break;
+            case NvsType::STR:
+                memcpy(slot, Fields[i].default_str, nvs_cstr_len(Fields[i].default_str) + 1);
+                break;
+            }
+        }
+    }
+
+    // Reads every field in one pass. Missing keys keep their default.
+    // Returns the first error other than ESP_ERR_NVS_NOT_FOUND.
+    esp_err_t load(Nvs &nvs)
+    {
+        esp_err_t result = ESP_OK;
+        for (size_t i = 0; i < FIELD_COUNT; i++)
+        {
+            const NvsField &field = Fields[i];
+            uint8_t *slot = data_ + OFFSETS[i];
+            esp_err_t err;
+            switch (field.type)
+            {
+            case NvsType::I32:
+            {
+                int value;
+                err = nvs.read(field.key, value);
+                if (err == ESP_OK)
+                {
+                    int32_t v = value;
+                    memcpy(slot, &v, sizeof(v));
+                }
+                break;
+            }
+            case NvsType::F64:
+            {
+                double value;
+                err = nvs.read(field.key, value);
+                if (err == ESP_OK)
+                    memcpy(slot, &value, sizeof(value));
+                break;
+            }
+            default:
+            {
+                // Read straight into the slot; restore the default if the value does not fit
+                size_t len = nvs_slot_size(field);
+                err = nvs.read(field.key, reinterpret_cast<char *>(slot), len);
+                if (err != ESP_OK)
+                    memcpy(slot, field.default_str, nvs_cstr_len(field.default_str) + 1);
+                break;
+            }
+            }
+
+            if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND)
+            {
+                ESP_LOGW(TAG, "Failed to load %s: %s", field.key, esp_err_to_name(err));
+                if (result == ESP_OK)
+                    result = err;
+            }
+        }
+        return result;
+    }
+
+    // Writes every field with a single commit. Inside a transaction of the caller the fields
+    // are only staged, and the caller's commit() or rollback() decides about them.
+    esp_err_t save(Nvs &nvs) const
+    {
+        std::optional<NvsTransaction> tx;
+        if (!nvs.in_transaction())
+            tx.emplace(nvs);
+        for (size_t i = 0; i < FIELD_COUNT; i++)
+        {
+            const uint8_t *slot = data_ + OFFSETS[i];
+            esp_err_t err;
+            switch (Fields[i].type)
+            {
+            case NvsType::I32:
+            {
+                int32_t v;
+                memcpy(&v, slot, sizeof(v));
+                err = nvs.write(Fields[i].key, static_cast<int>(v));
+                break;
+            }
+            case NvsType::F64:
+            {
+                double v;
+                memcpy(&v, slot, sizeof(v));
+                err = nvs.write(Fields[i].key, v);
+                break;
+            }
+            default:
+                err = nvs.write(Fields[i].key, reinterpret_cast<const char *>(slot));
+                break;
+            }
+            if (err != ESP_OK)
+            {
+                if (tx)
+                    tx->rollback();
+                return err;
+            }
+        }
+        return tx ? tx->commit() : ESP_OK;
+    }
+
+    template <size_t I>
+    auto get() const
+    {
+        static_assert(I < FIELD_COUNT, "NVS schema field index out of range");
+        const uint8_t *slot = data_ + OFFSETS[I];
+        if constexpr (Fields[I].type == NvsType::I32)
+        {
+            int32_t v;
+            memcpy(&v, slot, sizeof(v));
+            return v;
+        }
+        else if constexpr (Fields[I].type == NvsType::F64)
+        {
+            double v;
+            memcpy(&v, slot, sizeof(v));
+            return v;
+        }
+        else
+        {
+            return std::string_view(reinterpret_cast<const char *>(slot));
+        }
+    }
+
+    // Returns ESP_ERR_INVALID_SIZE if a string is longer than the field's max_len
+    template <size_t I, typename V>
+    esp_err_t set(const V &value)
+    {
+        static_assert(I < FIELD_COUNT, "NVS schema field index out of range");
+        uint8_t *slot = data_ + OFFSETS[I];
+        if constexpr (Fields[I].type == NvsType::I32)
+        {
+            int32_t v = static_cast<int32_t>(value);
+            memcpy(slot, &v, sizeof(v));
+        }
+        else if constexpr (Fields[I].type == NvsType::F64)
+        {
+            double v = static_cast<double>(value);
+            memcpy(slot, &v, sizeof(v));
+        }
+        else
+        {
+            std::string_view v(value);
+            if (v.size() > Fields[I].max_len)
+                return ESP_ERR_INVALID_SIZE;
+            memcpy(slot, v.data(), v.size());
+            slot[v.size()] = '\0';
+        }
+        return ESP_OK;
+    }
+
+    static constexpr const char *key(size_t i) { return Fields[i].key; }
+};
@@ -1,9 +1,137 @@
 #include "nvs.hpp"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#if CONFIG_IDF_TARGET_LINUX
+#include "nvs_host.hpp"
+#endif
 
-esp_err_t Nvs::open_namespace(std::string nvs_ns)
+static const char *TAG = "hv-nvs";
+
+static std::atomic<uint32_t> stat_set_ops{0};
+static std::atomic<uint32_t> stat_commits{0};
+static std::atomic<uint32_t> stat_bytes_set{0};
+
+// Idle flushes run in one shared task instead of the esp_timer task. Timers carry the
+// object id rather than a pointer, so a timer firing while its Nvs is destroyed is harmless.
+struct FlushRegistry
+{
+    std::mutex mutex;
+    std::condition_variable idle_cv; // signalled when a flush ends
+    std::map<uint32_t, Nvs *> live;
+    std::vector<uint32_t> due;
+    uint32_t next_id = 1;
+    uint32_t active = 0; // id being flushed, 0 when idle
+    TaskHandle_t task = nullptr;
+};
+
+static FlushRegistry &flush_registry()
+{
+    static FlushRegistry registry;
+    return registry;
+}
+
+// All writes to flash go through these so NvsStats sees every set and commit
+static esp_err_t counted_set(esp_err_t ret, size_t bytes)
+{
+    stat_set_ops++;
+    stat_bytes_set += bytes;
+#if CONFIG_HV_NVS_HOST_SIMULATE_LATENCY
+    nvs_host_simulate_latency();
+#endif
+    return ret;
+}
+
+static esp_err_t set_i32(nvs_handle_t handle, const char *key, int32_t v)
+{
+    return counted_set(nvs_set_i32(handle, key, v), sizeof(v));
+}
+
+static esp_err_t set_str(nvs_handle_t handle, const char *key, const char *v)
+{
+    return counted_set(nvs_set_str(handle, key, v), strlen(v) + 1);
+}
+
+static esp_err_t set_blob(nvs_handle_t handle, const char *key, const void *data, size_t len)
+{
+    return counted_set(nvs_set_blob(handle, key, data, len), len);
+}
+
+static esp_err_t commit_handle(nvs_handle_t handle)
+{
+    esp_err_t ret = nvs_commit(handle);
+    stat_commits++;
+#if CONFIG_HV_NVS_HOST_SIMULATE_LATENCY
+    nvs_host_simulate_latency();
+#endif
+    return ret;
+}
+
+// NVS needs NUL terminated names. Copy them to a stack buffer instead of a std::string.
+class NvsName
+{
+    char buf_[NVS_KEY_NAME_MAX_SIZE];
+    bool valid_;
+
+public:
+    explicit NvsName(std::string_view name) : valid_(!name.empty() && name.size() < sizeof(buf_))
+    {
+        if (valid_)
+        {
+            memcpy(buf_, name.data(), name.size());
+            buf_[name.size()] = '\0';
+        }
+        else
+        {
+            buf_[0] = '\0';
+        }
+    }
+
+    bool valid() const { return valid_; }
+    const char *c_str() const { return buf_; }
+};
+
+Nvs::~Nvs()
+{
+    if (commit_timer_)
+    {
+        esp_timer_stop(commit_timer_);
+        esp_timer_delete(commit_timer_);
+    }
+    if (flush_id_)
+    {
+        FlushRegistry &reg = flush_registry();
+        std::unique_lock<std::mutex> lock(reg.mutex);
+        reg.live.erase(flush_id_);
+        // A flush already running holds a pointer to this object
+        reg.idle_cv.wait(lock, [&] { return reg.active != flush_id_; });
+    }
+    if (is_initialized_ && handle_ != -1)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!pending_.empty())
+            {
+                flush_locked();
+            }
+        }
+        nvs_close(handle_);
+    }
+}
+
+esp_err_t Nvs::open_namespace(std::string_view nvs_ns)
 {
-    esp_err_t ret = nvs_open(nvs_ns.c_str(), NVS_READWRITE, &handle_);
+    NvsName ns(nvs_ns);
+    if (!ns.valid())
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    esp_err_t ret = nvs_open(ns.c_str(), NVS_READWRITE, &handle_);
     if (ret != ESP_OK)
     {
         handle_ = -1;
@@ -14,75 +142,524 @@ esp_err_t Nvs::open_namespace(std::string nvs_ns)
     return ret;
 }
 
-esp_err_t Nvs::write(std::string key, double v)
+esp_err_t Nvs::stage(std::string_view key, CachedValue v)
+{
+    if (!is_initialized_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (key.size() >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    auto it = pending_.find(key);
+    if (it != pending_.end())
+    {
+        it->second = std::move(v);
+    }
+    else
+    {
+        pending_.emplace(std::string(key), std::move(v));
+    }
+    arm_commit_timer();
+    return ESP_OK;
+}
+
+const Nvs::CachedValue *Nvs::find_pending(std::string_view key) const
+{
+    auto it = pending_.find(key);
+    return it != pending_.end() ? &it->second : nullptr;
+}
+
+esp_err_t Nvs::write(std::string_view key, double v)
+{
+    return write_record(key, v);
+}
+
+esp_err_t Nvs::write(std::string_view key, int v)
 {
-    esp_err_t ret = nvs_set_i32(handle_, key.c_str(), v);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (write_back_)
+            return stage(key, static_cast<int32_t>(v));
+    }
+    NvsName k(key);
+    if (!k.valid())
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    esp_err_t ret = set_i32(handle_, k.c_str(), v);
     if (ret == ESP_OK)
-        ret = nvs_commit(handle_);
+        ret = commit_handle(handle_);
     return ret;
 }
 
-esp_err_t Nvs::write(std::string key, int v)
+esp_err_t Nvs::write(std::string_view key, const char *v)
 {
-    esp_err_t ret = nvs_set_i32(handle_, key.c_str(), v);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (write_back_)
+            return stage(key, std::string(v));
+    }
+    NvsName k(key);
+    if (!k.valid())
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    esp_err_t ret = set_str(handle_, k.c_str(), v);
     if (ret == ESP_OK)
-        ret = nvs_commit(handle_);
+        ret = commit_handle(handle_);
     return ret;
 }
 
-esp_err_t Nvs::write(std::string key, std::string v)
+esp_err_t Nvs::write(std::string_view key, std::string_view v)
+{
+    // A string_view is not NUL terminated, short values get terminated on the stack
+    char buf[65];
+    if (v.size() < sizeof(buf))
+    {
+        memcpy(buf, v.data(), v.size());
+        buf[v.size()] = '\0';
+        return write(key, static_cast<const char *>(buf));
+    }
+    return write(key, std::string(v).c_str());
+}
+
+esp_err_t Nvs::write_blob(std::string_view key, const void *data, size_t len)
 {
-    esp_err_t ret = nvs_set_str(handle_, key.c_str(), v.c_str());
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (write_back_)
+        {
+            auto bytes = static_cast<const uint8_t *>(data);
+            return stage(key, std::vector<uint8_t>(bytes, bytes + len));
+        }
+    }
+    NvsName k(key);
+    if (!k.valid())
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    esp_err_t ret = set_blob(handle_, k.c_str(), data, len);
     if (ret == ESP_OK)
-        ret = nvs_commit(handle_);
+        ret = commit_handle(handle_);
     return ret;
 }
 
-esp_err_t Nvs::read(std::string key, double &v)
+esp_err_t Nvs::read(std::string_view key, double &v)
 {
-    int32_t value;
-    esp_err_t ret = nvs_get_i32(handle_, key.c_str(), &value);
-    if (ret == ESP_OK)
+    esp_err_t ret = read_record(key, v);
+    if (ret != ESP_ERR_NVS_NOT_FOUND)
     {
-        v = value * 1.0;
         return ret;
     }
-    else
+
+    // Values written by older versions of this component are plain int32 entries
+    int value;
+    ret = read(key, value);
+    if (ret == ESP_OK)
     {
-        v = 19.0;
-        return ret;
+        v = value * 1.0;
     }
+    return ret;
 }
 
-esp_err_t Nvs::read(std::string key, int &v)
+esp_err_t Nvs::read(std::string_view key, int &v)
 {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto cached = find_pending(key);
+        if (cached && std::holds_alternative<int32_t>(*cached))
+        {
+            v = std::get<int32_t>(*cached);
+            return ESP_OK;
+        }
+    }
+    NvsName k(key);
+    if (!k.valid())
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
     int32_t value;
-    esp_err_t ret = nvs_get_i32(handle_, key.c_str(), &value);
+    esp_err_t ret = nvs_get_i32(handle_, k.c_str(), &value);
     if (ret == ESP_OK)
     {
         v = value;
-        return ret;
     }
-    else
+    return ret;
+}
+
+esp_err_t Nvs::read(std::string_view key, std::string &v)
+{
     {
-        v = 9999;
-        return ret;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto cached = find_pending(key);
+        if (cached && std::holds_alternative<std::string>(*cached))
+        {
+            v = std::get<std::string>(*cached);
+            return ESP_OK;
+        }
     }
+    NvsName k(key);
+    size_t len = 0;
+    esp_err_t ret = k.valid() ? nvs_get_str(handle_, k.c_str(), nullptr, &len) : ESP_ERR_NVS_KEY_TOO_LONG;
+    if (ret == ESP_OK)
+    {
+        // len includes the terminating NUL, which std::string already provides room for
+        v.resize(len - 1);
+        ret = nvs_get_str(handle_, k.c_str(), v.data(), &len);
+    }
+    if (ret != ESP_OK)
+    {
+        v.clear();
+    }
+    return ret;
 }
 
-esp_err_t Nvs::read(std::string key, std::string &v)
+esp_err_t Nvs::read(std::string_view key, char *buf, size_t &len)
 {
-    char buf[65];
-    size_t len = sizeof(buf);
-    esp_err_t ret = nvs_get_str(handle_, key.c_str(), buf, &len);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto cached = find_pending(key);
+        if (cached && std::holds_alternative<std::string>(*cached))
+        {
+            const auto &s = std::get<std::string>(*cached);
+            size_t needed = s.size() + 1;
+            if (buf && len < needed)
+            {
+                len = needed;
+                return ESP_ERR_NVS_INVALID_LENGTH;
+            }
+            if (buf)
+            {
+                memcpy(buf, s.c_str(), needed);
+            }
+            len = needed;
+            return ESP_OK;
+        }
+    }
+    NvsName k(key);
+    if (!k.valid())
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    return nvs_get_str(handle_, k.c_str(), buf, &len);
+}
+
+esp_err_t Nvs::read_blob(std::string_view key, std::vector<uint8_t> &v)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto cached = find_pending(key);
+        if (cached && std::holds_alternative<std::vector<uint8_t>>(*cached))
+        {
+            v = std::get<std::vector<uint8_t>>(*cached);
+            return ESP_OK;
+        }
+    }
+    NvsName k(key);
+    size_t len = 0;
+    esp_err_t ret = k.valid() ? nvs_get_blob(handle_, k.c_str(), nullptr, &len) : ESP_ERR_NVS_KEY_TOO_LONG;
     if (ret == ESP_OK)
     {
-        v = std::string(buf, len);
-        return ret;
+        v.resize(len);
+        ret = nvs_get_blob(handle_, k.c_str(), v.data(), &len);
     }
-    else
+    if (ret != ESP_OK)
+    {
+        v.clear();
+    }
+    return ret;
+}
+
+esp_err_t Nvs::read_blob(std::string_view key, void *buf, size_t &len)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto cached = find_pending(key);
+        if (cached && std::holds_alternative<std::vector<uint8_t>>(*cached))
+        {
+            const auto &blob = std::get<std::vector<uint8_t>>(*cached);
+            if (buf && len < blob.size())
+            {
+                len = blob.size();
+                return ESP_ERR_NVS_INVALID_LENGTH;
+            }
+            if (buf)
+            {
+                memcpy(buf, blob.data(), blob.size());
+            }
+            len = blob.size();
+            return ESP_OK;
+        }
+    }
+    NvsName k(key);
+    if (!k.valid())
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    return nvs_get_blob(handle_, k.c_str(), buf, &len);
+}
+
+esp_err_t Nvs::erase_key(std::string_view key)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = pending_.find(key);
+    if (it != pending_.end())
+    {
+        pending_.erase(it);
+    }
+    NvsName k(key);
+    if (!k.valid())
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    esp_err_t ret = nvs_erase_key(handle_, k.c_str());
+    if (ret == ESP_OK)
+        ret = commit_handle(handle_);
+    return ret;
+}
+
+esp_err_t Nvs::erase_all()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    pending_.clear();
+    esp_err_t ret = nvs_erase_all(handle_);
+    if (ret == ESP_OK)
+        ret = commit_handle(handle_);
+    return ret;
+}
+
+void Nvs::seal_record(NvsRecordHeader &header, uint16_t version, const void *payload, size_t len)
+{
+    header.version = version;
+    header.size = static_cast<uint16_t>(len);
+    header.crc = record_crc(header, payload);
+}
+
+uint32_t Nvs::record_crc(const NvsRecordHeader &header, const void *payload)
+{
+    uint32_t crc = esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&header.version),
+                                    sizeof(header.version) + sizeof(header.size));
+    return esp_rom_crc32_le(crc, static_cast<const uint8_t *>(payload), header.size);
+}
+
+esp_err_t Nvs::load_record(std::string_view key, std::vector<uint8_t> &raw, NvsRecordHeader &header)
+{
+    esp_err_t ret = read_blob(key, raw);
+    if (ret != ESP_OK)
     {
-        v = "";
         return ret;
     }
+    if (raw.size() < sizeof(NvsRecordHeader))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(&header, raw.data(), sizeof(header));
+    // Older builds stored up to 3 bytes of struct padding after the payload
+    if (raw.size() < sizeof(header) + header.size || raw.size() - sizeof(header) - header.size >= alignof(NvsRecordHeader))
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (record_crc(header, raw.data() + sizeof(header)) != header.crc)
+    {
+        ESP_LOGE(TAG, "CRC mismatch in record %.*s", static_cast<int>(key.size()), key.data());
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
+
+NvsStats Nvs::stats()
+{
+    return {stat_set_ops.load(), stat_commits.load(), stat_bytes_set.load()};
+}
+
+void Nvs::reset_stats()
+{
+    stat_set_ops = 0;
+    stat_commits = 0;
+    stat_bytes_set = 0;
+}
+
+esp_err_t Nvs::begin()
+{
+    if (!is_initialized_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_back_ = true;
+    return ESP_OK;
+}
+
+esp_err_t Nvs::commit()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_back_ = false;
+    if (commit_timer_)
+    {
+        esp_timer_stop(commit_timer_);
+    }
+    return flush_locked();
+}
+
+void Nvs::rollback()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    write_back_ = false;
+    if (commit_timer_)
+    {
+        esp_timer_stop(commit_timer_);
+    }
+    pending_.clear();
+}
+
+bool Nvs::in_transaction() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return write_back_;
+}
+
+size_t Nvs::pending_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+bool Nvs::is_pending(std::string_view key) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return find_pending(key) != nullptr;
+}
+
+void Nvs::set_commit_delay(uint32_t ms)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    commit_delay_ms_ = ms;
+    if (ms == 0 && commit_timer_)
+    {
+        esp_timer_stop(commit_timer_);
+    }
+}
+
+esp_err_t Nvs::flush_locked()
+{
+    if (pending_.empty())
+    {
+        return ESP_OK;
+    }
+
+    esp_err_t ret = ESP_OK;
+    for (auto it = pending_.begin(); it != pending_.end();)
+    {
+        const char *key = it->first.c_str();
+        esp_err_t err;
+        if (std::holds_alternative<int32_t>(it->second))
+        {
+            err = set_i32(handle_, key, std::get<int32_t>(it->second));
+        }
+        else if (std::holds_alternative<std::string>(it->second))
+        {
+            err = set_str(handle_, key, std::get<std::string>(it->second).c_str());
+        }
+        else
+        {
+            const auto &blob = std::get<std::vector<uint8_t>>(it->second);
+            err = set_blob(handle_, key, blob.data(), blob.size());
+        }
+
+        if (err == ESP_OK)
+        {
+            it = pending_.erase(it);
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Failed to write key %s: %s", key, esp_err_to_name(err));
+            if (ret == ESP_OK)
+                ret = err;
+            ++it;
+        }
+    }
+
+    esp_err_t err = commit_handle(handle_);
+    return ret != ESP_OK ? ret : err;
+}
+
+void Nvs::arm_commit_timer()
+{
+    if (commit_delay_ms_ == 0)
+    {
+        return;
+    }
+    if (!commit_timer_)
+    {
+        FlushRegistry &reg = flush_registry();
+        {
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            if (!reg.task && xTaskCreate(idle_flush_task, "nvs_flush", CONFIG_HV_NVS_ASYNC_TASK_STACK_SIZE, nullptr,
+                                         CONFIG_HV_NVS_ASYNC_TASK_PRIORITY, &reg.task) != pdPASS)
+            {
+                reg.task = nullptr;
+                return;
+            }
+            if (!flush_id_)
+            {
+                flush_id_ = reg.next_id++;
+                reg.live[flush_id_] = this;
+            }
+        }
+        esp_timer_create_args_t args = {};
+        args.callback = &Nvs::commit_timer_cb;
+        args.arg = reinterpret_cast<void *>(static_cast<uintptr_t>(flush_id_));
+        args.name = "nvs_commit";
+        if (esp_timer_create(&args, &commit_timer_) != ESP_OK)
+        {
+            commit_timer_ = nullptr;
+            return;
+        }
+    }
+    // Restart the idle period on every staged write
+    esp_timer_stop(commit_timer_);
+    esp_timer_start_once(commit_timer_, static_cast<uint64_t>(commit_delay_ms_) * 1000);
+}
+
+void Nvs::commit_timer_cb(void *arg)
+{
+    // esp_timer task: no flash access here, the object may already be gone
+    uint32_t id = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(arg));
+    FlushRegistry &reg = flush_registry();
+    TaskHandle_t task;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        if (std::find(reg.due.begin(), reg.due.end(), id) == reg.due.end())
+        {
+            reg.due.push_back(id);
+        }
+        task = reg.task;
+    }
+    xTaskNotifyGive(task);
+}
+
+void Nvs::idle_flush_task(void *)
+{
+    FlushRegistry &reg = flush_registry();
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        std::unique_lock<std::mutex> lock(reg.mutex);
+        while (!reg.due.empty())
+        {
+            uint32_t id = reg.due.back();
+            reg.due.pop_back();
+            auto it = reg.live.find(id);
+            if (it == reg.live.end())
+            {
+                continue; // destroyed after its timer fired
+            }
+            Nvs *nvs = it->second;
+            reg.active = id;
+            // Never hold the registry while waiting for the object, writers lock them the other way round
+            lock.unlock();
+            esp_err_t err;
+            {
+                std::lock_guard<std::mutex> nvs_lock(nvs->mutex_);
+                err = nvs->flush_locked();
+            }
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Delayed commit failed: %s", esp_err_to_name(err));
+            }
+            lock.lock();
+            reg.active = 0;
+            reg.idle_cv.notify_all();
+        }
+    }
 }
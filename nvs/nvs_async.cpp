@@ -0,0 +1,253 @@
+#include "nvs_async.hpp"
+#include "nvs.hpp"
+#include "esp_log.h"
+#include <algorithm>
+#include <chrono>
+
+esp_err_t NvsAsyncWriter::start(UBaseType_t priority, uint32_t stack_size)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (task_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (xTaskCreate(writer_task, "nvs_async", stack_size, this, priority, &task_) != pdPASS)
+    {
+        task_ = nullptr;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t NvsAsyncWriter::post(std::string_view nvs_ns, std::string_view key, Value v)
+{
+    if (nvs_ns.empty() || nvs_ns.size() >= NVS_NS_NAME_MAX_SIZE || key.empty() || key.size() >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    TaskHandle_t task;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!task_)
+        {
+            return ESP_ERR_INVALID_STATE;
+        }
+        pending_[Key(nvs_ns, key)] = std::move(v);
+        posted_gen_++;
+        task = task_;
+    }
+    xTaskNotifyGive(task);
+    return ESP_OK;
+}
+
+esp_err_t NvsAsyncWriter::write(std::string_view nvs_ns, std::string_view key, int v)
+{
+    return post(nvs_ns, key, static_cast<int32_t>(v));
+}
+
+esp_err_t NvsAsyncWriter::write(std::string_view nvs_ns, std::string_view key, double v)
+{
+    return post(nvs_ns, key, v);
+}
+
+esp_err_t NvsAsyncWriter::write(std::string_view nvs_ns, std::string_view key, std::string_view v)
+{
+    return post(nvs_ns, key, std::string(v));
+}
+
+esp_err_t NvsAsyncWriter::write(std::string_view nvs_ns, std::string_view key, const char *v)
+{
+    return post(nvs_ns, key, std::string(v));
+}
+
+esp_err_t NvsAsyncWriter::write_blob(std::string_view nvs_ns, std::string_view key, const void *data, size_t len)
+{
+    auto bytes = static_cast<const uint8_t *>(data);
+    return post(nvs_ns, key, std::vector<uint8_t>(bytes, bytes + len));
+}
+
+esp_err_t NvsAsyncWriter::flush(TickType_t timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!task_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint64_t target = posted_gen_;
+    if (done_gen_ < target)
+    {
+        urgent_ = true;
+        xTaskNotifyGive(task_);
+        // Done, or a batch started after this call failed on some of the values
+        uint64_t batches = batches_;
+        auto done = [&]
+        { return done_gen_ >= target || (tried_gen_ >= target && batches_ > batches); };
+        if (timeout == portMAX_DELAY)
+        {
+            done_cv_.wait(lock, done);
+        }
+        else if (!done_cv_.wait_for(lock, std::chrono::milliseconds(pdTICKS_TO_MS(timeout)), done))
+        {
+            return ESP_ERR_TIMEOUT;
+        }
+        if (done_gen_ < target)
+        {
+            // Still queued for a retry, report the error again next time
+            return last_error_;
+        }
+    }
+
+    esp_err_t err = last_error_;
+    last_error_ = ESP_OK;
+    return err;
+}
+
+size_t NvsAsyncWriter::pending() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_.size();
+}
+
+esp_err_t NvsAsyncWriter::write_batch(std::map<Key, Value> &batch)
+{
+    esp_err_t result = ESP_OK;
+    auto it = batch.begin();
+    while (it != batch.end())
+    {
+        // The map is ordered by namespace: one transaction and commit per namespace
+        const std::string nvs_ns = it->first.first;
+        auto ns_end = it;
+        while (ns_end != batch.end() && ns_end->first.first == nvs_ns)
+            ++ns_end;
+        Nvs nvs;
+        esp_err_t err = nvs.open_namespace(nvs_ns);
+        if (err == ESP_OK)
+        {
+            err = nvs.begin();
+        }
+        if (err != ESP_OK)
+        {
+            // Nothing of this namespace was written, keep all of it
+            ESP_LOGE(TAG, "Opening namespace %s failed: %s", nvs_ns.c_str(), esp_err_to_name(err));
+            if (result == ESP_OK)
+                result = err;
+            it = ns_end;
+            continue;
+        }
+
+        // Staged keys fail one by one, a bad key does not hold back the others
+        for (auto key_it = it; key_it != ns_end; ++key_it)
+        {
+            const std::string &key = key_it->first.second;
+            const Value &v = key_it->second;
+            if (std::holds_alternative<int32_t>(v))
+                err = nvs.write(key, static_cast<int>(std::get<int32_t>(v)));
+            else if (std::holds_alternative<double>(v))
+                err = nvs.write(key, std::get<double>(v));
+            else if (std::holds_alternative<std::string>(v))
+                err = nvs.write(key, std::get<std::string>(v).c_str());
+            else
+                err = nvs.write_blob(key, std::get<std::vector<uint8_t>>(v).data(),
+                                     std::get<std::vector<uint8_t>>(v).size());
+            if (err != ESP_OK)
+            {
+                // Not staged, so not retried either: a retry cannot fix an invalid value
+                ESP_LOGE(TAG, "Dropping %s/%s: %s", nvs_ns.c_str(), key.c_str(), esp_err_to_name(err));
+                if (result == ESP_OK)
+                    result = err;
+            }
+        }
+        err = nvs.commit();
+        if (err != ESP_OK && result == ESP_OK)
+        {
+            result = err;
+        }
+
+        // commit() keeps the keys it could not write staged
+        while (it != ns_end)
+        {
+            if (nvs.is_pending(it->first.second))
+                ++it;
+            else
+                it = batch.erase(it);
+        }
+        // Failed values go back to the writer, not into this object's destructor
+        nvs.rollback();
+    }
+    return result;
+}
+
+void NvsAsyncWriter::writer_task(void *arg)
+{
+    auto *writer = static_cast<NvsAsyncWriter *>(arg);
+    const TickType_t batch_ticks = pdMS_TO_TICKS(CONFIG_HV_NVS_ASYNC_BATCH_MS);
+
+    for (;;)
+    {
+        uint32_t retry_ms;
+        {
+            std::lock_guard<std::mutex> lock(writer->mutex_);
+            retry_ms = writer->retry_ms_;
+        }
+        // Failed values are retried after the backoff even without new writes
+        ulTaskNotifyTake(pdTRUE, retry_ms ? pdMS_TO_TICKS(retry_ms) : portMAX_DELAY);
+
+        // Collect further writes for the batch window unless a flush is waiting
+        TickType_t start = xTaskGetTickCount();
+        for (;;)
+        {
+            {
+                std::lock_guard<std::mutex> lock(writer->mutex_);
+                if (writer->urgent_)
+                    break;
+            }
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= batch_ticks)
+                break;
+            ulTaskNotifyTake(pdTRUE, batch_ticks - elapsed);
+        }
+
+        std::map<Key, Value> batch;
+        uint64_t gen;
+        {
+            std::lock_guard<std::mutex> lock(writer->mutex_);
+            batch.swap(writer->pending_);
+            gen = writer->posted_gen_;
+            writer->urgent_ = false;
+        }
+
+        esp_err_t err = batch.empty() ? ESP_OK : writer->write_batch(batch);
+
+        {
+            std::lock_guard<std::mutex> lock(writer->mutex_);
+            if (batch.empty())
+            {
+                if (err == ESP_OK && writer->retry_ms_)
+                {
+                    // The retry went through, the error it reported is resolved
+                    writer->last_error_ = ESP_OK;
+                }
+                writer->done_gen_ = gen;
+                writer->retry_ms_ = 0;
+            }
+            else
+            {
+                // Retry failed values later, a newer value posted meanwhile wins
+                for (auto &entry : batch)
+                {
+                    writer->pending_.emplace(entry.first, std::move(entry.second));
+                }
+                writer->retry_ms_ = writer->retry_ms_ ? std::min(writer->retry_ms_ * 2, RETRY_MAX_MS) : RETRY_MIN_MS;
+                ESP_LOGW(TAG, "%u values not written, retry in %lu ms", (unsigned)batch.size(),
+                         (unsigned long)writer->retry_ms_);
+            }
+            if (err != ESP_OK && writer->last_error_ == ESP_OK)
+                writer->last_error_ = err;
+            writer->tried_gen_ = gen;
+            writer->batches_++;
+        }
+        writer->done_cv_.notify_all();
+    }
+}
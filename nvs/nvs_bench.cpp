@@ -0,0 +1,178 @@
+#include "nvs_bench.hpp"
+#include "esp_log.h"
+#include <chrono>
+#include <cstdio>
+
+static const char *TAG = "hv-nvs-bench";
+
+static constexpr int CONFIG_FIELDS = 30;
+static constexpr int LOG_SAMPLES = 200;
+static constexpr int LOG_SLOTS = 16;
+
+struct BenchConfig
+{
+    int32_t values[CONFIG_FIELDS - 2];
+    double setpoint;
+    char name[32];
+};
+
+static void clear_stats()
+{
+    Nvs::reset_stats();
+#if CONFIG_IDF_TARGET_LINUX
+    nvs_host_clear_stats();
+#endif
+}
+
+// Times fn() ops times and collects the counters of the run, stops at the first error
+template <typename Fn>
+static NvsBenchResult measure(const char *name, uint32_t ops, Fn fn)
+{
+    NvsBenchResult result = {};
+    result.name = name;
+    result.err = ESP_OK;
+    clear_stats();
+    for (uint32_t i = 0; i < ops && result.err == ESP_OK; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        result.err = fn(i);
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        result.ops++;
+        result.total_us += us;
+        if (us > result.max_us)
+            result.max_us = us;
+    }
+    result.nvs = Nvs::stats();
+#if CONFIG_IDF_TARGET_LINUX
+    result.flash = nvs_host_flash_stats();
+#endif
+    return result;
+}
+
+static void config_key(char (&key)[NVS_KEY_NAME_MAX_SIZE], int i)
+{
+    snprintf(key, sizeof(key), "cfg_%02d", i);
+}
+
+// Mixed settings: mostly ints, one double, one string
+static esp_err_t write_config_field(Nvs &nvs, int i)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    config_key(key, i);
+    if (i == CONFIG_FIELDS - 1)
+        return nvs.write(key, "bench-device");
+    if (i == CONFIG_FIELDS - 2)
+        return nvs.write(key, 21.5 + i);
+    return nvs.write(key, i * 7);
+}
+
+static esp_err_t read_config_field(Nvs &nvs, int i)
+{
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    config_key(key, i);
+    if (i == CONFIG_FIELDS - 1)
+    {
+        char name[32];
+        size_t len = sizeof(name);
+        return nvs.read(key, name, len);
+    }
+    if (i == CONFIG_FIELDS - 2)
+    {
+        double d = 0;
+        return nvs.read(key, d);
+    }
+    int v = 0;
+    return nvs.read(key, v);
+}
+
+void nvs_bench_print(const NvsBenchResult &r)
+{
+    if (r.err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%-16s failed after %lu ops: %s", r.name, (unsigned long)r.ops, esp_err_to_name(r.err));
+        return;
+    }
+    uint64_t avg = r.ops ? r.total_us / r.ops : 0;
+    if (r.flash.write_bytes && r.nvs.bytes_set)
+    {
+        ESP_LOGI(TAG, "%-16s ops=%4lu avg=%6llu us max=%6lu us sets=%4lu commits=%4lu "
+                      "flash: wr=%6u B erase=%3u amp=%.1fx sim=%llu us",
+                 r.name, (unsigned long)r.ops, (unsigned long long)avg, (unsigned long)r.max_us,
+                 (unsigned long)r.nvs.set_ops, (unsigned long)r.nvs.commits,
+                 (unsigned)r.flash.write_bytes, (unsigned)r.flash.erase_ops,
+                 (double)r.flash.write_bytes / r.nvs.bytes_set, (unsigned long long)r.flash.simulated_us);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "%-16s ops=%4lu avg=%6llu us max=%6lu us sets=%4lu commits=%4lu",
+                 r.name, (unsigned long)r.ops, (unsigned long long)avg, (unsigned long)r.max_us,
+                 (unsigned long)r.nvs.set_ops, (unsigned long)r.nvs.commits);
+    }
+}
+
+esp_err_t nvs_bench_run(const char *nvs_namespace, NvsBenchReportFn report)
+{
+    Nvs nvs;
+    esp_err_t ret = nvs.open_namespace(nvs_namespace);
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open namespace %s: %s", nvs_namespace, esp_err_to_name(ret));
+        return ret;
+    }
+    ret = nvs.erase_all();
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to clear namespace %s: %s", nvs_namespace, esp_err_to_name(ret));
+        return ret;
+    }
+
+    auto run = [&](const NvsBenchResult &result)
+    {
+        report(result);
+        if (ret == ESP_OK)
+            ret = result.err;
+    };
+
+    run(measure("config_single", CONFIG_FIELDS, [&](uint32_t i)
+                { return write_config_field(nvs, i); }));
+
+    run(measure("config_tx", 1, [&](uint32_t)
+                {
+                    NvsTransaction tx(nvs);
+                    for (int i = 0; i < CONFIG_FIELDS; i++)
+                    {
+                        esp_err_t err = write_config_field(nvs, i);
+                        if (err != ESP_OK)
+                        {
+                            tx.rollback();
+                            return err;
+                        }
+                    }
+                    return tx.commit();
+                }));
+
+    run(measure("config_read", CONFIG_FIELDS, [&](uint32_t i)
+                { return read_config_field(nvs, i); }));
+
+    BenchConfig cfg = {};
+    for (int i = 0; i < CONFIG_FIELDS - 2; i++)
+        cfg.values[i] = i * 7;
+    cfg.setpoint = 21.5;
+    snprintf(cfg.name, sizeof(cfg.name), "bench-device");
+
+    run(measure("record_write", 1, [&](uint32_t)
+                { return nvs.write_record("cfg_record", cfg); }));
+
+    run(measure("record_read", 1, [&](uint32_t)
+                { return nvs.read_record("cfg_record", cfg); }));
+
+    run(measure("log_append", LOG_SAMPLES, [&](uint32_t i)
+                {
+                    char key[NVS_KEY_NAME_MAX_SIZE];
+                    snprintf(key, sizeof(key), "log_%02lu", (unsigned long)(i % LOG_SLOTS));
+                    return nvs.write(key, static_cast<int>(i));
+                }));
+
+    esp_err_t err = nvs.erase_all();
+    return ret != ESP_OK ? ret : err;
+}
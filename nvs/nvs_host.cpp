@@ -0,0 +1,99 @@
+#include "nvs_host.hpp"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+#include <cstdio>
+#include <unistd.h>
+
+static const char *TAG = "hv-nvs-host";
+
+esp_err_t nvs_host_init(const char *image_path, bool erase)
+{
+    esp_partition_file_mmap_ctrl_t *ctrl = esp_partition_get_file_mmap_ctrl_input();
+    snprintf(ctrl->flash_file_name, sizeof(ctrl->flash_file_name), "%s", image_path);
+    ctrl->remove_dump = false;
+
+    esp_err_t ret = ESP_OK;
+    if (erase)
+    {
+        ret = nvs_flash_erase();
+    }
+    if (ret == ESP_OK)
+    {
+        ret = nvs_flash_init();
+    }
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_LOGW(TAG, "Flash image %s is not usable, erasing NVS", image_path);
+        ret = nvs_flash_erase();
+        if (ret == ESP_OK)
+            ret = nvs_flash_init();
+    }
+    if (ret != ESP_OK)
+    {
+        ESP_LOGE(TAG, "NVS init on %s failed: %s", image_path, esp_err_to_name(ret));
+        return ret;
+    }
+
+    nvs_host_clear_stats();
+    ESP_LOGI(TAG, "NVS backed by %s", image_path);
+    return ESP_OK;
+}
+
+void nvs_host_deinit()
+{
+    nvs_flash_deinit();
+    esp_partition_file_munmap();
+}
+
+#if CONFIG_HV_NVS_HOST_FLASH_STATS
+
+static uint64_t simulated_us(size_t erase_ops, size_t write_bytes)
+{
+    return static_cast<uint64_t>(erase_ops) * CONFIG_HV_NVS_HOST_SECTOR_ERASE_US +
+           static_cast<uint64_t>(write_bytes) * CONFIG_HV_NVS_HOST_PAGE_PROGRAM_US / 256;
+}
+
+NvsFlashStats nvs_host_flash_stats()
+{
+    NvsFlashStats stats = {};
+    stats.read_ops = esp_partition_get_read_ops();
+    stats.write_ops = esp_partition_get_write_ops();
+    stats.erase_ops = esp_partition_get_erase_ops();
+    stats.read_bytes = esp_partition_get_read_bytes();
+    stats.write_bytes = esp_partition_get_write_bytes();
+    stats.simulated_us = simulated_us(stats.erase_ops, stats.write_bytes);
+    return stats;
+}
+
+static uint64_t latency_applied_us = 0;
+
+void nvs_host_clear_stats()
+{
+    esp_partition_clear_stats();
+    latency_applied_us = 0;
+}
+
+void nvs_host_simulate_latency()
+{
+    uint64_t total = simulated_us(esp_partition_get_erase_ops(), esp_partition_get_write_bytes());
+    if (total > latency_applied_us)
+    {
+        usleep(total - latency_applied_us);
+        latency_applied_us = total;
+    }
+}
+
+#else
+
+NvsFlashStats nvs_host_flash_stats()
+{
+    return {};
+}
+
+void nvs_host_clear_stats()
+{
+}
+
+#endif
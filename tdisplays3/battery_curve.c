@@ -0,0 +1,50 @@
+// SPDX-FileCopyrightText: © 2025 Hiruna Wijesinghe <hiruna.kawinda@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include "battery_curve.h"
+#include "t_display_s3.h"
+#include "math.h"
+
+// volts_to_percentage() in tenths of a percent, every BAT_LUT_STEP_MILLIVOLTS from BAT_LUT_MIN_MILLIVOLTS
+// equation based on https://electronics.stackexchange.com/a/551667: 123 - 123 / (1 + (V / 3.7)^80)^0.165
+#define BAT_LUT_MIN_MILLIVOLTS 3300
+#define BAT_LUT_STEP_MILLIVOLTS 10
+static const uint16_t battery_lut[] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 1, 1, 1, 1, 1, 2,
+    2, 3, 4, 5, 6, 7, 9, 11, 14, 17,
+    21, 26, 32, 39, 48, 58, 69, 82, 97, 114,
+    133, 153, 175, 199, 223, 248, 275, 301, 328, 354,
+    381, 407, 433, 458, 483, 507, 530, 553, 575, 597,
+    618, 638, 657, 676, 694, 712, 728, 745, 761, 776,
+    791, 805, 819, 832, 845, 857, 869, 880, 892, 902,
+    913, 923, 932, 942, 951, 960, 968, 976, 984, 992,
+    999};
+#define BAT_LUT_LEN (sizeof(battery_lut) / sizeof(battery_lut[0]))
+
+// linear interpolation in battery_lut, clamped to 0-1000
+int battery_millivolts_to_permille(int millivolts)
+{
+    int offset = millivolts - BAT_LUT_MIN_MILLIVOLTS;
+    if (offset <= 0)
+    {
+        return 0;
+    }
+    int index = offset / BAT_LUT_STEP_MILLIVOLTS;
+    if (index >= (int)BAT_LUT_LEN - 1)
+    {
+        return 1000;
+    }
+    int frac = offset % BAT_LUT_STEP_MILLIVOLTS;
+    return battery_lut[index] + (battery_lut[index + 1] - battery_lut[index]) * frac / BAT_LUT_STEP_MILLIVOLTS;
+}
+
+double volts_to_percentage(double volts)
+{
+    return battery_millivolts_to_permille((int)(volts * 1000)) / 10.0;
+}
+
+bool usb_power_voltage(int milliVolts)
+{
+    return ceilf((float)(milliVolts - 100) / 1000) == 5.0;
+}
@@ -0,0 +1,8 @@
+// SPDX-FileCopyrightText: © 2025 Hiruna Wijesinghe <hiruna.kawinda@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+// Battery charge in tenths of a percent (0-1000) for the voltage at the battery,
+// shared by the ADC sampler and the host backend
+int battery_millivolts_to_permille(int millivolts);
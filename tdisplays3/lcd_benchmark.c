@@ -0,0 +1,155 @@
+// SPDX-FileCopyrightText: © 2025 Hiruna Wijesinghe <hiruna.kawinda@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include "lcd_benchmark.h"
+#include "t_display_s3.h"
+#include <esp_log.h>
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_timer.h"
+#endif
+
+static const char *TAG = "lcd_benchmark";
+
+#if CONFIG_IDF_TARGET_LINUX
+// the host backend runs LVGL in the caller's thread only
+#define benchmark_lock() true
+#define benchmark_unlock()
+
+static int64_t benchmark_now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#else
+#define benchmark_lock() lvgl_port_lock(1000)
+#define benchmark_unlock() lvgl_port_unlock()
+#define benchmark_now_us() esp_timer_get_time()
+#endif
+
+const char *lcd_buffer_strategy_name()
+{
+#if CONFIG_HV_TDISPLAYS3_BUFFER_SRAM_PARTIAL
+    return "sram-partial";
+#elif CONFIG_HV_TDISPLAYS3_BUFFER_PSRAM_DIRECT
+    return "psram-direct";
+#elif CONFIG_HV_TDISPLAYS3_BUFFER_HYBRID
+    return "hybrid";
+#else
+    return "psram-partial";
+#endif
+}
+
+typedef struct
+{
+    lcd_benchmark_result_t *result;
+    int64_t render_start_us;
+    int64_t wait_start_us;
+    uint64_t render_start_wait_us; // result->flush_wait_us at RENDER_START
+} benchmark_ctx_t;
+
+// display events arrive in the benchmark task while it is inside lv_refr_now()
+static void benchmark_event_cb(lv_event_t *e)
+{
+    benchmark_ctx_t *ctx = lv_event_get_user_data(e);
+    switch (lv_event_get_code(e))
+    {
+    case LV_EVENT_RENDER_START:
+        ctx->render_start_us = benchmark_now_us();
+        ctx->render_start_wait_us = ctx->result->flush_wait_us;
+        break;
+    case LV_EVENT_RENDER_READY:
+        // LVGL waits for a free buffer between chunks, that time is flushing, not drawing
+        ctx->result->render_us += benchmark_now_us() - ctx->render_start_us -
+                                  (ctx->result->flush_wait_us - ctx->render_start_wait_us);
+        break;
+    case LV_EVENT_FLUSH_WAIT_START:
+        ctx->wait_start_us = benchmark_now_us();
+        break;
+    case LV_EVENT_FLUSH_WAIT_FINISH:
+        ctx->result->flush_wait_us += benchmark_now_us() - ctx->wait_start_us;
+        break;
+    case LV_EVENT_FLUSH_START:
+    {
+        const lv_area_t *area = lv_event_get_param(e);
+        ctx->result->flushes++;
+        ctx->result->flush_bytes += lv_area_get_size(area) * sizeof(uint16_t);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+esp_err_t lcd_benchmark_run(lv_disp_t *disp, uint32_t frames, lcd_benchmark_result_t *result)
+{
+    if (disp == NULL || result == NULL || frames == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *result = (lcd_benchmark_result_t){
+        .strategy = lcd_buffer_strategy_name(),
+        .frames = frames,
+    };
+    benchmark_ctx_t ctx = {
+        .result = result,
+    };
+
+    if (!benchmark_lock())
+    {
+        return ESP_ERR_TIMEOUT;
+    }
+    lv_obj_t *previous = lv_display_get_screen_active(disp);
+    lv_obj_t *screen = lv_obj_create(NULL);
+    lv_obj_set_style_bg_grad_dir(screen, LV_GRAD_DIR_VER, 0);
+    lv_obj_set_style_bg_opa(screen, LV_OPA_COVER, 0);
+    lv_obj_t *label = lv_label_create(screen);
+    lv_obj_center(label);
+    lv_screen_load(screen);
+    // settle the first frame before timing
+    lv_refr_now(disp);
+
+    lv_display_add_event_cb(disp, benchmark_event_cb, LV_EVENT_ALL, &ctx);
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        // new colors and text force a full redraw each frame
+        lv_obj_set_style_bg_color(screen, lv_color_hsv_to_rgb((i * 3) % 360, 100, 60), 0);
+        lv_obj_set_style_bg_grad_color(screen, lv_color_hsv_to_rgb((i * 3 + 180) % 360, 100, 30), 0);
+        lv_label_set_text_fmt(label, "%s  frame %lu", result->strategy, (unsigned long)i);
+
+        int64_t start = benchmark_now_us();
+        lv_refr_now(disp);
+        uint32_t frame_us = benchmark_now_us() - start;
+        result->total_us += frame_us;
+        if (frame_us > result->frame_us_max)
+        {
+            result->frame_us_max = frame_us;
+        }
+    }
+    lv_display_remove_event_cb_with_user_data(disp, benchmark_event_cb, &ctx);
+
+    if (previous != NULL)
+    {
+        lv_screen_load(previous);
+    }
+    lv_obj_delete(screen);
+    benchmark_unlock();
+    return ESP_OK;
+}
+
+void lcd_benchmark_print(const lcd_benchmark_result_t *result)
+{
+    if (result->frames == 0 || result->total_us == 0)
+    {
+        return;
+    }
+    ESP_LOGI(TAG, "%s: %lu frames, %.1f fps, frame avg %lu us, max %lu us", result->strategy,
+             (unsigned long)result->frames, result->frames * 1e6 / result->total_us,
+             (unsigned long)(result->total_us / result->frames), (unsigned long)result->frame_us_max);
+    ESP_LOGI(TAG, "%s: render avg %lu us, flush wait avg %lu us, %lu flushes/frame, %.2f MB/s", result->strategy,
+             (unsigned long)(result->render_us / result->frames),
+             (unsigned long)(result->flush_wait_us / result->frames),
+             (unsigned long)(result->flushes / result->frames), (double)result->flush_bytes / result->total_us);
+}
@@ -0,0 +1,48 @@
+// SPDX-FileCopyrightText: © 2025 Hiruna Wijesinghe <hiruna.kawinda@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "esp_err.h"
+#include "lvgl.h"
+#else
+#include "esp_lvgl_port.h"
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#define LCD_BENCHMARK_DEFAULT_FRAMES 120
+
+    // Result of one benchmark run with the compiled-in draw buffer strategy
+    typedef struct
+    {
+        const char *strategy;   // lcd_buffer_strategy_name()
+        uint32_t frames;        // full screen redraws
+        uint32_t flushes;       // flush_cb calls, chunks per frame = flushes / frames
+        uint64_t flush_bytes;   // size of the flushed areas
+        uint64_t total_us;      // wall time of all frames
+        uint64_t render_us;     // of total_us: LVGL drawing into the buffers
+        uint64_t flush_wait_us; // of total_us: waiting for the DMA to free a buffer
+        uint32_t frame_us_max;  // slowest frame
+    } lcd_benchmark_result_t;
+
+    /**
+     * Redraws a full screen gradient with a label frames times on a temporary screen
+     * and times it with the LVGL display events. Waits for the i80 DMA to free a
+     * buffer happen inside LVGL's render window and are subtracted from render_us.
+     * Takes the LVGL port lock for the whole run and restores the previous screen
+     * afterwards.
+     */
+    esp_err_t lcd_benchmark_run(lv_disp_t *disp, uint32_t frames, lcd_benchmark_result_t *result);
+
+    // Logs FPS, frame, render and flush times and the bus throughput
+    void lcd_benchmark_print(const lcd_benchmark_result_t *result);
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
@@ -0,0 +1,52 @@
+// SPDX-FileCopyrightText: © 2025 Hiruna Wijesinghe <hiruna.kawinda@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "t_display_s3.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#if CONFIG_IDF_TARGET_LINUX
+
+    // Host backend of lcd_init(): LVGL renders LCD_H_RES x LCD_V_RES RGB565 into an in-memory
+    // framebuffer in the caller's thread. There is no LVGL task and no real clock; time only
+    // moves with lcd_host_tick(), so runs are repeatable and go at full CPU speed.
+
+    // Advances the LVGL clock by ms in steps of LVGL_TICK_PERIOD_MS and runs the LVGL timers,
+    // which refresh the display when something changed
+    void lcd_host_tick(uint32_t ms);
+
+    // Renders all pending changes now
+    void lcd_host_refresh();
+
+    // Visible image, row by row. With CONFIG_HV_TDISPLAYS3_HOST_SWAP_BYTES the pixels are
+    // byte swapped, as esp_lvgl_port sends them to the ST7789.
+    const uint16_t *lcd_host_framebuffer();
+
+    // Frames completed since lcd_init()
+    uint32_t lcd_host_frame_count();
+
+    // Binary PPM (P6) and PNG (uncompressed) of the framebuffer in RGB888
+    esp_err_t lcd_host_save_ppm(const char *path);
+
+    esp_err_t lcd_host_save_png(const char *path);
+
+    // Writes dir/frame_00000.ppm, frame_00001.ppm, ... after every frame, NULL stops
+    void lcd_host_dump_frames(const char *dir);
+
+    // Compares the framebuffer with a P6 PPM of the same size. Pixels with a channel
+    // differing by more than tolerance are counted in diff_pixels.
+    esp_err_t lcd_host_diff_ppm(const char *reference_path, uint8_t tolerance, uint32_t *diff_pixels);
+
+    // Battery voltage served by get_battery_voltage() and the snapshot
+    void lcd_host_set_battery(int millivolts);
+
+#endif
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
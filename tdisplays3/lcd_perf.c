@@ -0,0 +1,240 @@
+// SPDX-FileCopyrightText: © 2025 Hiruna Wijesinghe <hiruna.kawinda@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include "lcd_perf.h"
+#include <esp_log.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "lcd_perf";
+
+#define LCD_PERF_WINDOW_US 1000000
+#define LCD_PERF_OVERLAY_PERIOD_MS 500
+
+static lv_disp_t *perf_disp;
+static lcd_perf_stats_t perf_stats;
+// frame in progress, LVGL task only
+static lcd_frame_stats_t perf_frame;
+static int64_t perf_frame_start_us;
+static int64_t perf_render_start_us;
+static int64_t perf_wait_start_us;
+static uint32_t perf_render_start_wait_us; // perf_frame.flush_wait_us at render start
+static bool perf_frame_rendered;
+// fps window, LVGL task only
+static int64_t perf_window_start_us;
+static uint32_t perf_window_frames;
+static uint64_t perf_window_busy_us;
+// written by the LVGL task at flush start, read by the transfer-done ISR
+static volatile int64_t perf_flush_start_us;
+static volatile uint32_t perf_frame_dma_us;
+// perf_stats and perf_frame_dma_us
+static portMUX_TYPE perf_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static lv_obj_t *perf_overlay;
+static lv_timer_t *perf_overlay_timer;
+
+static bool perf_trans_done(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_io_event_data_t *edata, void *user_ctx)
+{
+    uint32_t dma_us = esp_timer_get_time() - perf_flush_start_us;
+    taskENTER_CRITICAL_ISR(&perf_lock);
+    perf_frame_dma_us += dma_us;
+    perf_stats.dma_us_sum += dma_us;
+    if (dma_us > perf_stats.dma_us_max)
+    {
+        perf_stats.dma_us_max = dma_us;
+    }
+    taskEXIT_CRITICAL_ISR(&perf_lock);
+
+    // what esp_lvgl_port's own callback does in the version pinned in idf_component.yml
+    lv_display_flush_ready((lv_display_t *)user_ctx);
+    return false;
+}
+
+static void perf_frame_done(int64_t now)
+{
+    perf_frame.frame_us = now - perf_frame_start_us;
+
+    perf_window_frames++;
+    perf_window_busy_us += perf_frame.frame_us;
+    int64_t window_us = now - perf_window_start_us;
+
+    taskENTER_CRITICAL(&perf_lock);
+    perf_frame.dma_us = perf_frame_dma_us;
+    perf_frame_dma_us = 0;
+    perf_stats.last = perf_frame;
+    perf_stats.frames++;
+    perf_stats.frame_us_sum += perf_frame.frame_us;
+    perf_stats.render_us_sum += perf_frame.render_us;
+    perf_stats.flush_wait_us_sum += perf_frame.flush_wait_us;
+    perf_stats.pixels_sum += perf_frame.pixels;
+    if (perf_frame.frame_us > perf_stats.frame_us_max)
+    {
+        perf_stats.frame_us_max = perf_frame.frame_us;
+    }
+    if (perf_frame.render_us > perf_stats.render_us_max)
+    {
+        perf_stats.render_us_max = perf_frame.render_us;
+    }
+    if (window_us >= LCD_PERF_WINDOW_US)
+    {
+        perf_stats.fps = perf_window_frames * 1e6f / window_us;
+        perf_stats.busy_pct = perf_window_busy_us * 100 / window_us;
+    }
+    taskEXIT_CRITICAL(&perf_lock);
+
+    if (window_us >= LCD_PERF_WINDOW_US)
+    {
+        perf_window_start_us = now;
+        perf_window_frames = 0;
+        perf_window_busy_us = 0;
+    }
+}
+
+// LVGL task, inside lv_timer_handler() or lv_refr_now()
+static void perf_event_cb(lv_event_t *e)
+{
+    int64_t now = esp_timer_get_time();
+    switch (lv_event_get_code(e))
+    {
+    case LV_EVENT_INVALIDATE_AREA:
+        perf_frame.dirty_areas++;
+        break;
+    case LV_EVENT_REFR_START:
+        perf_frame_start_us = now;
+        perf_frame_rendered = false;
+        break;
+    case LV_EVENT_RENDER_START:
+        perf_render_start_us = now;
+        perf_render_start_wait_us = perf_frame.flush_wait_us;
+        perf_frame_rendered = true;
+        break;
+    case LV_EVENT_RENDER_READY:
+        // LVGL waits for a free buffer inside the render pass, that is flushing, not drawing
+        perf_frame.render_us += now - perf_render_start_us - (perf_frame.flush_wait_us - perf_render_start_wait_us);
+        break;
+    case LV_EVENT_FLUSH_WAIT_START:
+        perf_wait_start_us = now;
+        break;
+    case LV_EVENT_FLUSH_WAIT_FINISH:
+        perf_frame.flush_wait_us += now - perf_wait_start_us;
+        break;
+    case LV_EVENT_FLUSH_START:
+    {
+        const lv_area_t *area = lv_event_get_param(e);
+        perf_flush_start_us = now;
+        perf_frame.flushes++;
+        perf_frame.pixels += lv_area_get_size(area);
+        break;
+    }
+    case LV_EVENT_REFR_READY:
+        // refreshes without dirty areas are no frames
+        if (perf_frame_rendered)
+        {
+            perf_frame_done(now);
+            perf_frame = (lcd_frame_stats_t){0};
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+esp_err_t lcd_perf_start(lv_disp_t *disp, esp_lcd_panel_io_handle_t io_handle)
+{
+    if (disp == NULL || io_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (perf_disp != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const esp_lcd_panel_io_callbacks_t cbs = {
+        .on_color_trans_done = perf_trans_done,
+    };
+    esp_err_t err = esp_lcd_panel_io_register_event_callbacks(io_handle, &cbs, disp);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "transfer-done hook failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    lvgl_port_lock(0);
+    perf_disp = disp;
+    perf_window_start_us = esp_timer_get_time();
+    lv_display_add_event_cb(disp, perf_event_cb, LV_EVENT_ALL, NULL);
+    lvgl_port_unlock();
+    return ESP_OK;
+}
+
+void lcd_perf_get(lcd_perf_stats_t *stats)
+{
+    taskENTER_CRITICAL(&perf_lock);
+    *stats = perf_stats;
+    taskEXIT_CRITICAL(&perf_lock);
+}
+
+void lcd_perf_reset()
+{
+    taskENTER_CRITICAL(&perf_lock);
+    perf_stats = (lcd_perf_stats_t){0};
+    taskEXIT_CRITICAL(&perf_lock);
+}
+
+void lcd_perf_print()
+{
+    lcd_perf_stats_t stats;
+    lcd_perf_get(&stats);
+    if (stats.frames == 0)
+    {
+        ESP_LOGI(TAG, "no frames");
+        return;
+    }
+    ESP_LOGI(TAG, "%lu frames, %.1f fps, busy %u%%, %lu px/frame", (unsigned long)stats.frames, stats.fps,
+             stats.busy_pct, (unsigned long)(stats.pixels_sum / stats.frames));
+    ESP_LOGI(TAG, "frame avg %lu us, max %lu us; render avg %lu us, max %lu us; dma avg %lu us, max %lu us",
+             (unsigned long)(stats.frame_us_sum / stats.frames), (unsigned long)stats.frame_us_max,
+             (unsigned long)(stats.render_us_sum / stats.frames), (unsigned long)stats.render_us_max,
+             (unsigned long)(stats.dma_us_sum / stats.frames), (unsigned long)stats.dma_us_max);
+    ESP_LOGI(TAG, "flush wait avg %lu us", (unsigned long)(stats.flush_wait_us_sum / stats.frames));
+}
+
+static void perf_overlay_update(lv_timer_t *timer)
+{
+    lcd_perf_stats_t stats;
+    lcd_perf_get(&stats);
+    // lv_snprintf may be built without float support
+    lv_label_set_text_fmt(perf_overlay, "%lu fps %u%%\nr %lu w %lu d %lu us", (unsigned long)(stats.fps + 0.5f),
+                          stats.busy_pct, (unsigned long)stats.last.render_us, (unsigned long)stats.last.flush_wait_us,
+                          (unsigned long)stats.last.dma_us);
+}
+
+void lcd_perf_overlay_show(bool show)
+{
+    lvgl_port_lock(0);
+    if (show && perf_overlay == NULL)
+    {
+        perf_overlay = lv_label_create(lv_display_get_layer_top(perf_disp != NULL ? perf_disp : lv_display_get_default()));
+        lv_obj_set_style_bg_color(perf_overlay, lv_color_black(), 0);
+        lv_obj_set_style_bg_opa(perf_overlay, LV_OPA_70, 0);
+        lv_obj_set_style_text_color(perf_overlay, lv_color_white(), 0);
+        lv_obj_set_style_pad_all(perf_overlay, 2, 0);
+        lv_obj_align(perf_overlay, LV_ALIGN_BOTTOM_RIGHT, 0, 0);
+        lv_label_set_text(perf_overlay, "-- fps");
+        perf_overlay_timer = lv_timer_create(perf_overlay_update, LCD_PERF_OVERLAY_PERIOD_MS, NULL);
+    }
+    else if (!show && perf_overlay != NULL)
+    {
+        lv_timer_delete(perf_overlay_timer);
+        lv_obj_delete(perf_overlay);
+        perf_overlay_timer = NULL;
+        perf_overlay = NULL;
+    }
+    lvgl_port_unlock();
+}
+
+bool lcd_perf_overlay_visible()
+{
+    return perf_overlay != NULL;
+}
@@ -0,0 +1,69 @@
+// SPDX-FileCopyrightText: © 2025 Hiruna Wijesinghe <hiruna.kawinda@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "esp_lvgl_port.h"
+#include "esp_lcd_panel_io.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // One refresh of the display by LVGL
+    typedef struct
+    {
+        uint32_t frame_us;      // refresh start to refresh ready
+        uint32_t render_us;     // of frame_us: drawing into the buffers, flush waits excluded
+        uint32_t flush_wait_us; // of frame_us: waiting for a transfer to free a buffer
+        uint32_t dma_us;        // i80 transfers completed during the frame, flush start to transfer done
+        uint32_t pixels;        // pixels flushed
+        uint16_t flushes;       // flush_cb calls
+        uint16_t dirty_areas;   // invalidated areas before LVGL joins them
+    } lcd_frame_stats_t;
+
+    // Since lcd_perf_start() or lcd_perf_reset()
+    typedef struct
+    {
+        lcd_frame_stats_t last;  // most recent frame
+        uint32_t frames;
+        uint64_t frame_us_sum;   // averages = *_sum / frames
+        uint64_t render_us_sum;
+        uint64_t flush_wait_us_sum;
+        uint64_t dma_us_sum;
+        uint64_t pixels_sum;
+        uint32_t frame_us_max;
+        uint32_t render_us_max;
+        uint32_t dma_us_max;     // single i80 transfer
+        float fps;               // frames in the last full second
+        uint8_t busy_pct;        // share of that second LVGL spent refreshing
+    } lcd_perf_stats_t;
+
+    /**
+     * Hooks the LVGL display events and the i80 transfer-done callback of io_handle.
+     * The transfer-done callback replaces the one esp_lvgl_port registered and calls
+     * lv_display_flush_ready() itself, like the port does. The panel IO offers no way to read
+     * back the registered callback, so it cannot be chained. This matches the esp_lvgl_port
+     * 2.6.x i80 path (lvgl_port_flush_io_ready_callback() with the lv_display_t as user_ctx),
+     * which idf_component.yml pins. Compare that callback again before raising the pin.
+     * lcd_init() calls this with CONFIG_HV_TDISPLAYS3_PERF.
+     */
+    esp_err_t lcd_perf_start(lv_disp_t *disp, esp_lcd_panel_io_handle_t io_handle);
+
+    void lcd_perf_get(lcd_perf_stats_t *stats);
+
+    void lcd_perf_reset();
+
+    // Logs averages and maxima of render, DMA and frame times and the average flush wait
+    void lcd_perf_print();
+
+    // Label in the top layer with FPS, busy share and the last frame's times, updated every 500 ms.
+    // Its own redraws are small but show up in the statistics.
+    void lcd_perf_overlay_show(bool show);
+
+    bool lcd_perf_overlay_visible();
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
@@ -5,11 +5,16 @@
 #include <stdio.h>
 #include <esp_log.h>
 #include "esp_adc/adc_oneshot.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
 #include <soc/adc_channel.h>
 #include <esp_lcd_panel_st7789.h>
 #include <driver/ledc.h>
-#include "math.h"
 #include "aw9364.h"
+#include "esp_heap_caps.h"
+#include "battery_curve.h"
+#include "lcd_benchmark.h"
+#include "lcd_perf.h"
 //
 
 static const char *TAG = "esp_idf_t_display_s3";
@@ -18,6 +23,13 @@ static const char *TAG = "esp_idf_t_display_s3";
 static adc_oneshot_unit_handle_t adc_handle;
 // ADC calibration handle for battery voltage monitoring
 static adc_cali_handle_t adc_cali_handle;
+// Battery sampler: moving average over the last samples, snapshot for readers
+static esp_timer_handle_t battery_timer;
+static int battery_window[CONFIG_HV_TDISPLAYS3_BATTERY_FILTER_LEN];
+static int battery_window_sum;
+static int battery_window_pos;
+static battery_snapshot_t battery_snapshot;
+static portMUX_TYPE battery_lock = portMUX_INITIALIZER_UNLOCKED;
 // AW9364 handle (brightness controller)
 static aw9364_dev_handle_t aw9364_dev_hdl;
 
@@ -40,8 +52,8 @@ static void init_lcd_i80_bus(esp_lcd_panel_io_handle_t *io_handle)
             LCD_PIN_NUM_DATA6,
             LCD_PIN_NUM_DATA7},
         .bus_width = LCD_I80_BUS_WIDTH,
-        // transfer 100 lines of pixels (assume pixel is RGB565) at most in one transaction
-        .max_transfer_bytes = LCD_H_RES * 100 * sizeof(uint16_t),
+        // largest flush of the draw buffer strategy (assume pixel is RGB565) in one transaction
+        .max_transfer_bytes = LCD_H_RES * LCD_MAX_TRANSFER_LINES * sizeof(uint16_t),
         .psram_trans_align = LCD_PSRAM_TRANS_ALIGN,
         .sram_trans_align = LCD_SRAM_TRANS_ALIGN,
     };
@@ -57,9 +69,16 @@ static void init_lcd_i80_bus(esp_lcd_panel_io_handle_t *io_handle)
             .dc_dummy_level = LCD_I80_DC_DUMMY_LEVEL,
             .dc_data_level = LCD_I80_DC_DATA_LEVEL,
         },
+#if CONFIG_HV_TDISPLAYS3_BUFFER_PSRAM_DIRECT
+        // direct mode renders into a full frame that must stay unswapped, so the DMA swaps
+        .flags = {
+            .swap_color_bytes = true,
+        },
+#else
         //            .flags = {
         //                    .swap_color_bytes = !LV_COLOR_16_SWAP, // Swap can be done in LvGL (default) or DMA
         //            },
+#endif
         //            .user_ctx = user_ctx,
         .lcd_cmd_bits = LCD_CMD_BITS,
         .lcd_param_bits = LCD_PARAM_BITS,
@@ -108,6 +127,10 @@ static void init_battery_adc()
 
 static void init_battery_monitor()
 {
+    if (adc_cali_handle != NULL)
+    {
+        return;
+    }
     ESP_LOGI(TAG, "Configuring battery monitor...");
     /* Initialize ADC and get ADC handle */
     init_battery_adc();
@@ -128,35 +151,152 @@ static void init_battery_monitor()
     ESP_ERROR_CHECK(adc_cali_create_scheme_curve_fitting(&cali_config, &adc_cali_handle));
 }
 
-int get_battery_voltage()
+// blocking ADC read and calibration, millivolts at the battery (1:2 divider)
+static esp_err_t read_battery_millivolts(int *millivolts)
 {
     int voltage, adc_raw;
 
     assert(adc_handle);
-    ESP_ERROR_CHECK(adc_oneshot_read(adc_handle, ADC_CHANNEL_3, &adc_raw));
-    ESP_ERROR_CHECK(adc_cali_raw_to_voltage(adc_cali_handle, adc_raw, &voltage));
-    return voltage * 2;
+    esp_err_t err = adc_oneshot_read(adc_handle, ADC_CHANNEL_3, &adc_raw);
+    if (err == ESP_OK)
+    {
+        err = adc_cali_raw_to_voltage(adc_cali_handle, adc_raw, &voltage);
+    }
+    if (err == ESP_OK)
+    {
+        *millivolts = voltage * 2;
+    }
+    return err;
 }
 
-double volts_to_percentage(double volts)
+static void battery_sample(void *arg)
 {
-    // equation based on https://electronics.stackexchange.com/a/551667
-    return 123 - ((double)123 / pow((1 + pow(((double)volts / 3.7), 80)), 0.165));
+    int millivolts;
+    if (read_battery_millivolts(&millivolts) != ESP_OK)
+    {
+        // keep the last snapshot
+        return;
+    }
+
+    battery_window_sum += millivolts - battery_window[battery_window_pos];
+    battery_window[battery_window_pos] = millivolts;
+    battery_window_pos = (battery_window_pos + 1) % CONFIG_HV_TDISPLAYS3_BATTERY_FILTER_LEN;
+    int filtered = battery_window_sum / CONFIG_HV_TDISPLAYS3_BATTERY_FILTER_LEN;
+
+    battery_snapshot_t snapshot = {
+        .millivolts = filtered,
+        .percentage = (battery_millivolts_to_permille(filtered) + 9) / 10,
+        .usb_power = usb_power_voltage(filtered),
+        .samples = battery_snapshot.samples + 1,
+        .updated_us = esp_timer_get_time(),
+    };
+    taskENTER_CRITICAL(&battery_lock);
+    battery_snapshot = snapshot;
+    taskEXIT_CRITICAL(&battery_lock);
 }
 
-int get_battery_percentage()
+esp_err_t battery_monitor_start()
 {
-    return (int)ceil(volts_to_percentage((double)get_battery_voltage() / 1000));
+    if (battery_timer != NULL)
+    {
+        return ESP_OK;
+    }
+    init_battery_monitor();
+
+    // fill the filter with a first reading, so the snapshot is valid right away
+    int millivolts;
+    esp_err_t err = read_battery_millivolts(&millivolts);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "battery read failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    for (int i = 0; i < CONFIG_HV_TDISPLAYS3_BATTERY_FILTER_LEN; i++)
+    {
+        battery_window[i] = millivolts;
+    }
+    battery_window_sum = millivolts * CONFIG_HV_TDISPLAYS3_BATTERY_FILTER_LEN;
+    battery_window_pos = 0;
+    battery_sample(NULL);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = battery_sample,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "battery",
+        .skip_unhandled_events = true,
+    };
+    err = esp_timer_create(&timer_args, &battery_timer);
+    if (err == ESP_OK)
+    {
+        err = esp_timer_start_periodic(battery_timer, CONFIG_HV_TDISPLAYS3_BATTERY_SAMPLE_MS * 1000ULL);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "battery timer failed: %s", esp_err_to_name(err));
+        if (battery_timer != NULL)
+        {
+            esp_timer_delete(battery_timer);
+            battery_timer = NULL;
+        }
+    }
+    return err;
 }
 
-bool usb_power_voltage(int milliVolts)
+void battery_monitor_stop()
 {
-    return ceilf((float)(milliVolts - 100) / 1000) == 5.0;
+    if (battery_timer != NULL)
+    {
+        esp_timer_stop(battery_timer);
+        esp_timer_delete(battery_timer);
+        battery_timer = NULL;
+    }
+}
+
+bool battery_get_snapshot(battery_snapshot_t *snapshot)
+{
+    if (battery_timer == NULL)
+    {
+        return false;
+    }
+    taskENTER_CRITICAL(&battery_lock);
+    *snapshot = battery_snapshot;
+    taskEXIT_CRITICAL(&battery_lock);
+    return true;
+}
+
+int get_battery_voltage()
+{
+    battery_snapshot_t snapshot;
+    if (battery_get_snapshot(&snapshot))
+    {
+        return snapshot.millivolts;
+    }
+
+    // sampler not running: one blocking read
+    int millivolts;
+    init_battery_monitor();
+    ESP_ERROR_CHECK(read_battery_millivolts(&millivolts));
+    return millivolts;
+}
+
+int get_battery_percentage()
+{
+    battery_snapshot_t snapshot;
+    if (battery_get_snapshot(&snapshot))
+    {
+        return snapshot.percentage;
+    }
+    return (battery_millivolts_to_permille(get_battery_voltage()) + 9) / 10;
 }
 
 bool usb_power_connected()
 {
-    return usb_power_voltage((double)get_battery_voltage());
+    battery_snapshot_t snapshot;
+    if (battery_get_snapshot(&snapshot))
+    {
+        return snapshot.usb_power;
+    }
+    return usb_power_voltage(get_battery_voltage());
 }
 
 static void lcd_power_init(void)
@@ -240,15 +380,33 @@ uint8_t lcd_get_brightness_pct()
     return aw9364_get_brightness_pct(aw9364_dev_hdl);
 }
 
+#if CONFIG_HV_TDISPLAYS3_BUFFER_HYBRID
+// the port allocated the internal buffer, LVGL alternates between it and one in PSRAM
+static void lcd_lvgl_add_psram_buffer(lv_disp_t *disp)
+{
+    const size_t bytes = LVGL_BUFFER_SIZE * sizeof(uint16_t);
+    void *psram_buf = heap_caps_aligned_alloc(LCD_PSRAM_TRANS_ALIGN, bytes, MALLOC_CAP_SPIRAM);
+    if (psram_buf == NULL)
+    {
+        ESP_LOGE(TAG, "no PSRAM for the second draw buffer, staying single buffered");
+        return;
+    }
+    lvgl_port_lock(0);
+    lv_draw_buf_t *sram_buf = lv_display_get_buf_active(disp);
+    lv_display_set_buffers(disp, sram_buf->data, psram_buf, bytes, LV_DISPLAY_RENDER_MODE_PARTIAL);
+    lvgl_port_unlock();
+}
+#endif
+
 static lv_disp_t *lcd_lvgl_add_disp(esp_lcd_panel_io_handle_t io_handle, esp_lcd_panel_handle_t panel_handle)
 {
-    ESP_LOGI(TAG, "Adding display driver to lvgl port...");
+    ESP_LOGI(TAG, "Adding display driver to lvgl port (%s draw buffers)...", lcd_buffer_strategy_name());
     /* Add LCD screen */
     const lvgl_port_display_cfg_t disp_cfg = {
         .io_handle = io_handle,
         .panel_handle = panel_handle,
         .buffer_size = LVGL_BUFFER_SIZE,
-        .double_buffer = true,
+        .double_buffer = LVGL_DOUBLE_BUFFER,
         .hres = LCD_H_RES,
         .vres = LCD_V_RES,
         .monochrome = false,
@@ -260,10 +418,19 @@ static lv_disp_t *lcd_lvgl_add_disp(esp_lcd_panel_io_handle_t io_handle, esp_lcd
             .mirror_y = false,
         },
         .flags = {
-            .buff_spiram = true,
-            .swap_bytes = true,
+            .buff_dma = LVGL_BUFFER_DMA,
+            .buff_spiram = LVGL_BUFFER_SPIRAM,
+            .swap_bytes = !LVGL_DIRECT_MODE,
+            .direct_mode = LVGL_DIRECT_MODE,
         }};
-    return lvgl_port_add_disp(&disp_cfg);
+    lv_disp_t *disp = lvgl_port_add_disp(&disp_cfg);
+#if CONFIG_HV_TDISPLAYS3_BUFFER_HYBRID
+    if (disp != NULL)
+    {
+        lcd_lvgl_add_psram_buffer(disp);
+    }
+#endif
+    return disp;
 }
 
 void lcd_init(lv_disp_t **disp_handle, bool backlight_on)
@@ -286,7 +453,9 @@ void lcd_init(lv_disp_t **disp_handle, bool backlight_on)
     lcd_power_init();
     lcd_brightness_init();
 
-    // init_battery_monitor();
+#if CONFIG_HV_TDISPLAYS3_BATTERY_MONITOR
+    battery_monitor_start();
+#endif
 
     /* LCD IO */
     esp_lcd_panel_io_handle_t io_handle = NULL;
@@ -300,8 +469,23 @@ void lcd_init(lv_disp_t **disp_handle, bool backlight_on)
 
     *disp_handle = disp_hdl;
 
+#if CONFIG_HV_TDISPLAYS3_PERF
+    lcd_perf_start(disp_hdl, io_handle);
+#if CONFIG_HV_TDISPLAYS3_PERF_OVERLAY
+    lcd_perf_overlay_show(true);
+#endif
+#endif
+
     if (backlight_on)
     {
         lcd_set_brightness_step(100);
     }
+
+#if CONFIG_HV_TDISPLAYS3_BENCHMARK_ON_INIT
+    lcd_benchmark_result_t result;
+    if (lcd_benchmark_run(disp_hdl, LCD_BENCHMARK_DEFAULT_FRAMES, &result) == ESP_OK)
+    {
+        lcd_benchmark_print(&result);
+    }
+#endif
 }
\ No newline at end of file
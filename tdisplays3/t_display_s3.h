@@ -3,7 +3,13 @@
 
 #pragma once
 
+#include "sdkconfig.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include "esp_err.h"
+#include "lvgl.h"
+#else
 #include "esp_lvgl_port.h"
+#endif
 
 #ifdef __cplusplus
 extern "C"
@@ -74,8 +80,35 @@ extern "C"
 #define LCD_PSRAM_TRANS_ALIGN 64
 #define LCD_SRAM_TRANS_ALIGN 4
 
+// LVGL draw buffers and the largest i80 transfer, per Kconfig strategy (sizes in pixels)
+#if CONFIG_HV_TDISPLAYS3_BUFFER_SRAM_PARTIAL || CONFIG_HV_TDISPLAYS3_BUFFER_HYBRID
+#define LVGL_BUFFER_SIZE (LCD_H_RES * CONFIG_HV_TDISPLAYS3_BUFFER_LINES)
+#define LCD_MAX_TRANSFER_LINES CONFIG_HV_TDISPLAYS3_BUFFER_LINES
+#define LVGL_BUFFER_DMA true
+#define LVGL_BUFFER_SPIRAM false
+#elif CONFIG_HV_TDISPLAYS3_BUFFER_PSRAM_DIRECT
+#define LVGL_BUFFER_SIZE (LCD_H_RES * LCD_V_RES)
+#define LCD_MAX_TRANSFER_LINES LCD_V_RES
+#define LVGL_BUFFER_DMA false
+#define LVGL_BUFFER_SPIRAM true
+#else
 // best to keep this as is (1/10th of the display pixels)
 #define LVGL_BUFFER_SIZE (((LCD_H_RES * LCD_V_RES) / 10) + LCD_H_RES)
+#define LCD_MAX_TRANSFER_LINES 100
+#define LVGL_BUFFER_DMA false
+#define LVGL_BUFFER_SPIRAM true
+#endif
+// hybrid: the port allocates one internal buffer, lcd_init() adds one in PSRAM
+#if CONFIG_HV_TDISPLAYS3_BUFFER_HYBRID
+#define LVGL_DOUBLE_BUFFER false
+#else
+#define LVGL_DOUBLE_BUFFER true
+#endif
+#if CONFIG_HV_TDISPLAYS3_BUFFER_PSRAM_DIRECT
+#define LVGL_DIRECT_MODE true
+#else
+#define LVGL_DIRECT_MODE false
+#endif
 
 // LVGL Timer options (configurable via Kconfig)
 #define LVGL_TICK_PERIOD_MS CONFIG_HV_TDISPLAYS3_LVGL_TICK_PERIOD_MS
@@ -101,6 +134,29 @@ extern "C"
 
     uint8_t lcd_get_brightness_pct();
 
+    // Name of the Kconfig draw buffer strategy, e.g. "sram-partial"
+    const char *lcd_buffer_strategy_name();
+
+    // Filtered battery reading kept by the sampler started with battery_monitor_start()
+    typedef struct
+    {
+        int millivolts;     // moving average over CONFIG_HV_TDISPLAYS3_BATTERY_FILTER_LEN samples
+        int percentage;     // 0-100
+        bool usb_power;     // usb_power_voltage(millivolts)
+        uint32_t samples;   // since battery_monitor_start()
+        int64_t updated_us; // esp_timer_get_time() of the last sample
+    } battery_snapshot_t;
+
+    // Samples the battery every CONFIG_HV_TDISPLAYS3_BATTERY_SAMPLE_MS from an esp_timer.
+    // Called by lcd_init() with CONFIG_HV_TDISPLAYS3_BATTERY_MONITOR.
+    esp_err_t battery_monitor_start();
+
+    void battery_monitor_stop();
+
+    // Copies the latest snapshot, false if the sampler is not running
+    bool battery_get_snapshot(battery_snapshot_t *snapshot);
+
+    // The getters below serve the snapshot while the sampler runs, otherwise they read the ADC
     int get_battery_voltage();
 
     int get_battery_percentage();
@@ -0,0 +1,454 @@
+// SPDX-FileCopyrightText: © 2025 Hiruna Wijesinghe <hiruna.kawinda@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Linux target: same entry points as t_display_s3.c without i80 bus, ST7789, AW9364 and ADC
+
+#include "lcd_host.h"
+#include "battery_curve.h"
+#include "lcd_benchmark.h"
+#include <esp_log.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "t_display_s3_host";
+
+#define AW9364_MAX_STEP 16
+#define HOST_DUMP_PATH_MAX 256
+
+static lv_display_t *host_disp;
+// what the panel shows, LCD_H_RES x LCD_V_RES
+static uint16_t host_framebuffer[LCD_H_RES * LCD_V_RES];
+static uint32_t host_tick_ms;
+static uint32_t host_frames;
+static char host_dump_dir[HOST_DUMP_PATH_MAX];
+static uint8_t host_brightness_step;
+static int host_battery_millivolts = 4000;
+static bool host_battery_running;
+
+static uint32_t host_tick_cb(void)
+{
+    return host_tick_ms;
+}
+
+static uint16_t host_pixel(size_t index)
+{
+    uint16_t pixel = host_framebuffer[index];
+#if CONFIG_HV_TDISPLAYS3_HOST_SWAP_BYTES
+    pixel = (uint16_t)((pixel << 8) | (pixel >> 8));
+#endif
+    return pixel;
+}
+
+// RGB888 of the framebuffer, row by row
+static uint8_t *host_rgb888()
+{
+    uint8_t *rgb = malloc(LCD_H_RES * LCD_V_RES * 3);
+    if (rgb == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < LCD_H_RES * LCD_V_RES; i++)
+    {
+        uint16_t pixel = host_pixel(i);
+        uint8_t r = (pixel >> 11) & 0x1F;
+        uint8_t g = (pixel >> 5) & 0x3F;
+        uint8_t b = pixel & 0x1F;
+        rgb[i * 3] = (r << 3) | (r >> 2);
+        rgb[i * 3 + 1] = (g << 2) | (g >> 4);
+        rgb[i * 3 + 2] = (b << 3) | (b >> 2);
+    }
+    return rgb;
+}
+
+static void host_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map)
+{
+    const uint16_t *src = (const uint16_t *)px_map;
+    int32_t width = lv_area_get_width(area);
+#if CONFIG_HV_TDISPLAYS3_BUFFER_PSRAM_DIRECT
+    // direct mode: px_map is the whole frame
+    int32_t src_stride = LCD_H_RES;
+    src += area->y1 * LCD_H_RES + area->x1;
+#else
+    int32_t src_stride = width;
+#endif
+    for (int32_t y = area->y1; y <= area->y2; y++)
+    {
+        uint16_t *dst = &host_framebuffer[y * LCD_H_RES + area->x1];
+#if CONFIG_HV_TDISPLAYS3_HOST_SWAP_BYTES
+        // as esp_lvgl_port's swap_bytes does before the i80 transfer
+        for (int32_t x = 0; x < width; x++)
+        {
+            dst[x] = (uint16_t)((src[x] << 8) | (src[x] >> 8));
+        }
+#else
+        memcpy(dst, src, width * sizeof(uint16_t));
+#endif
+        src += src_stride;
+    }
+
+    if (lv_display_flush_is_last(disp))
+    {
+        if (host_dump_dir[0] != '\0')
+        {
+            char path[HOST_DUMP_PATH_MAX + 32];
+            snprintf(path, sizeof(path), "%s/frame_%05lu.ppm", host_dump_dir, (unsigned long)host_frames);
+            lcd_host_save_ppm(path);
+        }
+        host_frames++;
+    }
+    lv_display_flush_ready(disp);
+}
+
+void lcd_init(lv_disp_t **disp_handle, bool backlight_on)
+{
+    ESP_LOGI(TAG, "Host display %dx%d, %s draw buffers", LCD_H_RES, LCD_V_RES, lcd_buffer_strategy_name());
+    lv_init();
+    lv_tick_set_cb(host_tick_cb);
+
+    host_disp = lv_display_create(LCD_H_RES, LCD_V_RES);
+    lv_display_set_color_format(host_disp, LV_COLOR_FORMAT_RGB565);
+    lv_display_set_flush_cb(host_disp, host_flush_cb);
+
+    // same buffer sizes as the device, all in host memory
+    const size_t bytes = LVGL_BUFFER_SIZE * sizeof(uint16_t);
+    void *buf1 = malloc(bytes);
+    void *buf2 = malloc(bytes);
+    assert(buf1 != NULL && buf2 != NULL);
+#if CONFIG_HV_TDISPLAYS3_BUFFER_PSRAM_DIRECT
+    lv_display_set_buffers(host_disp, buf1, buf2, bytes, LV_DISPLAY_RENDER_MODE_DIRECT);
+#else
+    lv_display_set_buffers(host_disp, buf1, buf2, bytes, LV_DISPLAY_RENDER_MODE_PARTIAL);
+#endif
+
+    *disp_handle = host_disp;
+
+    if (backlight_on)
+    {
+        lcd_set_brightness_step(100);
+    }
+
+#if CONFIG_HV_TDISPLAYS3_BENCHMARK_ON_INIT
+    lcd_benchmark_result_t result;
+    if (lcd_benchmark_run(host_disp, LCD_BENCHMARK_DEFAULT_FRAMES, &result) == ESP_OK)
+    {
+        lcd_benchmark_print(&result);
+    }
+#endif
+}
+
+void lcd_host_tick(uint32_t ms)
+{
+    for (uint32_t elapsed = 0; elapsed < ms; elapsed += LVGL_TICK_PERIOD_MS)
+    {
+        host_tick_ms += LVGL_TICK_PERIOD_MS;
+        lv_timer_handler();
+    }
+}
+
+void lcd_host_refresh()
+{
+    lv_refr_now(host_disp);
+}
+
+const uint16_t *lcd_host_framebuffer()
+{
+    return host_framebuffer;
+}
+
+uint32_t lcd_host_frame_count()
+{
+    return host_frames;
+}
+
+esp_err_t lcd_host_save_ppm(const char *path)
+{
+    uint8_t *rgb = host_rgb888();
+    if (rgb == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        free(rgb);
+        ESP_LOGE(TAG, "cannot write %s", path);
+        return ESP_FAIL;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", LCD_H_RES, LCD_V_RES);
+    size_t written = fwrite(rgb, 1, LCD_H_RES * LCD_V_RES * 3, f);
+    fclose(f);
+    free(rgb);
+    return written == LCD_H_RES * LCD_V_RES * 3 ? ESP_OK : ESP_FAIL;
+}
+
+static uint32_t png_crc_table[256];
+
+static uint32_t png_crc(uint32_t crc, const uint8_t *data, size_t len)
+{
+    if (png_crc_table[1] == 0)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            png_crc_table[n] = c;
+        }
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = png_crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static bool png_chunk(FILE *f, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t header[8];
+    uint8_t trailer[4];
+    put_be32(header, len);
+    memcpy(header + 4, type, 4);
+    uint32_t crc = png_crc(png_crc(0, header + 4, 4), data, len);
+    put_be32(trailer, crc);
+    return fwrite(header, 1, 8, f) == 8 && fwrite(data, 1, len, f) == len && fwrite(trailer, 1, 4, f) == 4;
+}
+
+esp_err_t lcd_host_save_png(const char *path)
+{
+    // filter byte 0 per row, zlib stream of stored deflate blocks: no compression library needed
+    const size_t row_bytes = 1 + LCD_H_RES * 3;
+    const size_t raw_len = row_bytes * LCD_V_RES;
+    const size_t block_max = 65535;
+    const size_t blocks = (raw_len + block_max - 1) / block_max;
+    const size_t idat_len = 2 + raw_len + blocks * 5 + 4;
+
+    uint8_t *rgb = host_rgb888();
+    uint8_t *raw = malloc(raw_len);
+    uint8_t *idat = malloc(idat_len);
+    if (rgb == NULL || raw == NULL || idat == NULL)
+    {
+        free(rgb);
+        free(raw);
+        free(idat);
+        return ESP_ERR_NO_MEM;
+    }
+    for (size_t y = 0; y < LCD_V_RES; y++)
+    {
+        raw[y * row_bytes] = 0;
+        memcpy(&raw[y * row_bytes + 1], &rgb[y * LCD_H_RES * 3], LCD_H_RES * 3);
+    }
+    free(rgb);
+
+    size_t pos = 0;
+    idat[pos++] = 0x78; // deflate, 32K window
+    idat[pos++] = 0x01;
+    uint32_t adler_a = 1;
+    uint32_t adler_b = 0;
+    for (size_t offset = 0; offset < raw_len; offset += block_max)
+    {
+        size_t len = raw_len - offset < block_max ? raw_len - offset : block_max;
+        idat[pos++] = offset + len == raw_len ? 1 : 0; // BFINAL, stored
+        idat[pos++] = len & 0xFF;
+        idat[pos++] = len >> 8;
+        idat[pos++] = ~len & 0xFF;
+        idat[pos++] = (~len >> 8) & 0xFF;
+        memcpy(&idat[pos], &raw[offset], len);
+        pos += len;
+        for (size_t i = 0; i < len; i++)
+        {
+            adler_a = (adler_a + raw[offset + i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+    }
+    put_be32(&idat[pos], (adler_b << 16) | adler_a);
+    pos += 4;
+    free(raw);
+
+    uint8_t ihdr[13];
+    put_be32(ihdr, LCD_H_RES);
+    put_be32(ihdr + 4, LCD_V_RES);
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = 2;  // truecolor
+    ihdr[10] = 0; // deflate
+    ihdr[11] = 0; // adaptive filtering
+    ihdr[12] = 0; // no interlace
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    FILE *f = fopen(path, "wb");
+    if (f == NULL)
+    {
+        free(idat);
+        ESP_LOGE(TAG, "cannot write %s", path);
+        return ESP_FAIL;
+    }
+    bool ok = fwrite(signature, 1, sizeof(signature), f) == sizeof(signature) &&
+              png_chunk(f, "IHDR", ihdr, sizeof(ihdr)) && png_chunk(f, "IDAT", idat, pos) &&
+              png_chunk(f, "IEND", NULL, 0);
+    fclose(f);
+    free(idat);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+void lcd_host_dump_frames(const char *dir)
+{
+    if (dir == NULL)
+    {
+        host_dump_dir[0] = '\0';
+        return;
+    }
+    snprintf(host_dump_dir, sizeof(host_dump_dir), "%s", dir);
+}
+
+esp_err_t lcd_host_diff_ppm(const char *reference_path, uint8_t tolerance, uint32_t *diff_pixels)
+{
+    FILE *f = fopen(reference_path, "rb");
+    if (f == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    int width, height, max;
+    if (fscanf(f, "P6 %d %d %d", &width, &height, &max) != 3 || fgetc(f) == EOF || width != LCD_H_RES ||
+        height != LCD_V_RES || max != 255)
+    {
+        fclose(f);
+        ESP_LOGE(TAG, "%s is no %dx%d P6 PPM", reference_path, LCD_H_RES, LCD_V_RES);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *reference = malloc(LCD_H_RES * LCD_V_RES * 3);
+    uint8_t *rgb = host_rgb888();
+    if (reference == NULL || rgb == NULL)
+    {
+        fclose(f);
+        free(reference);
+        free(rgb);
+        return ESP_ERR_NO_MEM;
+    }
+    size_t read = fread(reference, 1, LCD_H_RES * LCD_V_RES * 3, f);
+    fclose(f);
+
+    esp_err_t err = ESP_ERR_INVALID_SIZE;
+    if (read == LCD_H_RES * LCD_V_RES * 3)
+    {
+        uint32_t diff = 0;
+        for (size_t i = 0; i < LCD_H_RES * LCD_V_RES; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                if (abs(rgb[i * 3 + c] - reference[i * 3 + c]) > tolerance)
+                {
+                    diff++;
+                    break;
+                }
+            }
+        }
+        *diff_pixels = diff;
+        err = ESP_OK;
+    }
+    free(reference);
+    free(rgb);
+    return err;
+}
+
+// Backlight: only the state, for UI code that reads it back
+
+void lcd_set_brightness_step(uint8_t brightness_step)
+{
+    host_brightness_step = brightness_step > AW9364_MAX_STEP ? AW9364_MAX_STEP : brightness_step;
+}
+
+void lcd_set_brightness_step_fade(uint8_t brightness_step, uint32_t fade_time_ms)
+{
+    lcd_set_brightness_step(brightness_step);
+}
+
+void lcd_set_brightness_pct(uint8_t brightness_percent)
+{
+    lcd_set_brightness_step((brightness_percent > 100 ? 100 : brightness_percent) * AW9364_MAX_STEP / 100);
+}
+
+void lcd_set_brightness_pct_fade(uint8_t brightness_percent, uint32_t fade_time_ms)
+{
+    lcd_set_brightness_pct(brightness_percent);
+}
+
+void lcd_increment_brightness_step()
+{
+    lcd_set_brightness_step(host_brightness_step + 1);
+}
+
+void lcd_decrement_brightness_step()
+{
+    if (host_brightness_step > 0)
+    {
+        lcd_set_brightness_step(host_brightness_step - 1);
+    }
+}
+
+uint8_t lcd_get_brightness_step()
+{
+    return host_brightness_step;
+}
+
+uint8_t lcd_get_brightness_pct()
+{
+    return host_brightness_step * 100 / AW9364_MAX_STEP;
+}
+
+// Battery: the voltage set with lcd_host_set_battery()
+
+void lcd_host_set_battery(int millivolts)
+{
+    host_battery_millivolts = millivolts;
+}
+
+esp_err_t battery_monitor_start()
+{
+    host_battery_running = true;
+    return ESP_OK;
+}
+
+void battery_monitor_stop()
+{
+    host_battery_running = false;
+}
+
+bool battery_get_snapshot(battery_snapshot_t *snapshot)
+{
+    if (!host_battery_running)
+    {
+        return false;
+    }
+    snapshot->millivolts = host_battery_millivolts;
+    snapshot->percentage = get_battery_percentage();
+    snapshot->usb_power = usb_power_connected();
+    snapshot->samples = 1;
+    snapshot->updated_us = (int64_t)host_tick_ms * 1000;
+    return true;
+}
+
+int get_battery_voltage()
+{
+    return host_battery_millivolts;
+}
+
+int get_battery_percentage()
+{
+    return (battery_millivolts_to_permille(host_battery_millivolts) + 9) / 10;
+}
+
+bool usb_power_connected()
+{
+    return usb_power_voltage(host_battery_millivolts);
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "sdkconfig.h"
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+static constexpr size_t TSLOG_CHANNELS = CONFIG_HV_TSLOG_CHANNELS;
+
+// One decoded sample
+struct TsSample
+{
+    uint32_t timestamp;              // seconds, epoch or uptime as chosen by the writer
+    int32_t values[TSLOG_CHANNELS];  // fixed point values, e.g. 0.01 °C and Pa
+};
+
+// Written once at the start of every sector. The first sample of the sector is stored
+// here in full; records hold deltas against it.
+struct TsSectorHeader
+{
+    uint32_t magic;
+    uint32_t seq; // increments with every sector written, 0xFFFFFFFF = erased
+    uint32_t base_time;
+    int32_t base[TSLOG_CHANNELS];
+    uint32_t crc; // CRC32 over all fields above
+};
+
+// Fixed-size delta record. All 0xFF bytes mark a free slot.
+struct TsRecord
+{
+    uint16_t dt; // seconds since base_time, 0xFFFF is never written
+    int16_t dv[TSLOG_CHANNELS];
+    uint16_t crc; // CRC16 over dt and dv
+};
+
+class TsLog;
+
+/**
+ * @brief Forward iterator over the log, oldest sample first
+ *
+ * Reads straight from the memory mapped partition. If the writer wraps around and
+ * erases the sector a cursor is reading, the cursor continues at the oldest sector.
+ */
+class TsLogCursor
+{
+    friend class TsLog;
+
+    const TsLog *log_;
+    uint32_t sector_;
+    uint32_t seq_;
+    uint32_t index_;
+
+    TsLogCursor(const TsLog *log, uint32_t sector, uint32_t seq) : log_(log), sector_(sector), seq_(seq), index_(0) {}
+
+public:
+    TsLogCursor() : log_(nullptr), sector_(0), seq_(0), index_(0) {}
+
+    // Returns false when no further sample is available yet
+    bool next(TsSample &sample);
+};
+
+/**
+ * @brief Append-only ring log of fixed-size, delta-encoded samples in a raw data partition
+ *
+ * Each flash sector holds a CRC protected header with a full base sample followed by
+ * records with 16 bit deltas. A sample that does not fit the deltas starts a new sector.
+ * When the partition is full the oldest sector is erased, so flash wear is one sector
+ * erase per sector of samples.
+ */
+class TsLog
+{
+    friend class TsLogCursor;
+
+public:
+    explicit TsLog(const char *partition_label = CONFIG_HV_TSLOG_PARTITION_LABEL);
+    ~TsLog();
+
+    TsLog(const TsLog &) = delete;
+    TsLog &operator=(const TsLog &) = delete;
+
+    // Finds and maps the partition and locates the write position
+    esp_err_t init();
+
+    esp_err_t append(uint32_t timestamp, const int32_t (&values)[TSLOG_CHANNELS]);
+    // Erases the whole partition
+    esp_err_t clear();
+
+    TsLogCursor oldest() const;
+    // First sample with timestamp >= since. Whole sectors are skipped by their base time.
+    TsLogCursor since(uint32_t timestamp) const;
+
+    uint32_t sector_count() const { return sector_count_; }
+    static constexpr uint32_t records_per_sector() { return RECORDS_PER_SECTOR; }
+
+private:
+    static constexpr uint32_t SECTOR_SIZE = 4096;
+    static constexpr uint32_t MAGIC = 0x54534c31; // "TSL1"
+    static constexpr uint32_t ERASED_SEQ = 0xFFFFFFFF;
+    static constexpr uint32_t RECORDS_PER_SECTOR = (SECTOR_SIZE - sizeof(TsSectorHeader)) / sizeof(TsRecord);
+    static constexpr const char *TAG = "TsLog";
+
+    const TsSectorHeader *header(uint32_t sector) const;
+    const TsRecord *record(uint32_t sector, uint32_t index) const;
+    bool header_valid(uint32_t sector) const;
+    static bool record_free(const TsRecord *rec);
+    static bool record_valid(const TsRecord *rec);
+    uint32_t find_free_index(uint32_t sector) const;
+    uint32_t oldest_sector() const;
+    esp_err_t start_sector(uint32_t timestamp, const int32_t (&values)[TSLOG_CHANNELS]);
+
+    const char *label_;
+    const esp_partition_t *partition_;
+    const uint8_t *map_;
+    esp_partition_mmap_handle_t map_handle_;
+    uint32_t sector_count_;
+    uint32_t head_sector_;
+    uint32_t head_seq_;
+    uint32_t head_index_; // next free record in the head sector
+    bool has_head_;
+    mutable std::mutex mutex_;
+};
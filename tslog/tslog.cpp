@@ -0,0 +1,318 @@
+#include "tslog.hpp"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include <cstddef>
+#include <cstring>
+
+static uint32_t header_crc(const TsSectorHeader &header)
+{
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&header), offsetof(TsSectorHeader, crc));
+}
+
+static uint16_t record_crc(const TsRecord &rec)
+{
+    return esp_rom_crc16_le(0, reinterpret_cast<const uint8_t *>(&rec), offsetof(TsRecord, crc));
+}
+
+TsLog::TsLog(const char *partition_label)
+    : label_(partition_label), partition_(nullptr), map_(nullptr), map_handle_(0), sector_count_(0),
+      head_sector_(0), head_seq_(0), head_index_(0), has_head_(false)
+{
+}
+
+TsLog::~TsLog()
+{
+    if (map_)
+    {
+        esp_partition_munmap(map_handle_);
+    }
+}
+
+esp_err_t TsLog::init()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (map_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    partition_ = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label_);
+    if (!partition_)
+    {
+        ESP_LOGE(TAG, "Partition %s not found", label_);
+        return ESP_ERR_NOT_FOUND;
+    }
+    sector_count_ = partition_->size / SECTOR_SIZE;
+    if (sector_count_ < 2)
+    {
+        ESP_LOGE(TAG, "Partition %s needs at least 2 sectors", label_);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const void *ptr;
+    esp_err_t err = esp_partition_mmap(partition_, 0, sector_count_ * SECTOR_SIZE, ESP_PARTITION_MMAP_DATA, &ptr,
+                                       &map_handle_);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to map partition %s: %s", label_, esp_err_to_name(err));
+        return err;
+    }
+    map_ = static_cast<const uint8_t *>(ptr);
+
+    // The head is the valid sector with the highest sequence number
+    has_head_ = false;
+    for (uint32_t s = 0; s < sector_count_; s++)
+    {
+        if (header_valid(s) && (!has_head_ || header(s)->seq > head_seq_))
+        {
+            has_head_ = true;
+            head_sector_ = s;
+            head_seq_ = header(s)->seq;
+        }
+    }
+    head_index_ = has_head_ ? find_free_index(head_sector_) : 0;
+
+    ESP_LOGI(TAG, "%s: %lu sectors of %lu records, head %lu/%lu", label_, (unsigned long)sector_count_,
+             (unsigned long)RECORDS_PER_SECTOR, (unsigned long)head_sector_, (unsigned long)head_index_);
+    return ESP_OK;
+}
+
+const TsSectorHeader *TsLog::header(uint32_t sector) const
+{
+    return reinterpret_cast<const TsSectorHeader *>(map_ + sector * SECTOR_SIZE);
+}
+
+const TsRecord *TsLog::record(uint32_t sector, uint32_t index) const
+{
+    return reinterpret_cast<const TsRecord *>(map_ + sector * SECTOR_SIZE + sizeof(TsSectorHeader)) + index;
+}
+
+bool TsLog::header_valid(uint32_t sector) const
+{
+    const TsSectorHeader *h = header(sector);
+    return h->magic == MAGIC && h->seq != ERASED_SEQ && h->crc == header_crc(*h);
+}
+
+bool TsLog::record_free(const TsRecord *rec)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(rec);
+    for (size_t i = 0; i < sizeof(TsRecord); i++)
+    {
+        if (bytes[i] != 0xFF)
+            return false;
+    }
+    return true;
+}
+
+bool TsLog::record_valid(const TsRecord *rec)
+{
+    return rec->dt != 0xFFFF && rec->crc == record_crc(*rec);
+}
+
+uint32_t TsLog::find_free_index(uint32_t sector) const
+{
+    // Records are written in order, so the free slots are a suffix of the sector
+    uint32_t lo = 0;
+    uint32_t hi = RECORDS_PER_SECTOR;
+    while (lo < hi)
+    {
+        uint32_t mid = (lo + hi) / 2;
+        if (record_free(record(sector, mid)))
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+uint32_t TsLog::oldest_sector() const
+{
+    // Sectors are written in ring order, the first valid one after the head is the oldest
+    for (uint32_t i = 1; i <= sector_count_; i++)
+    {
+        uint32_t s = (head_sector_ + i) % sector_count_;
+        if (header_valid(s))
+            return s;
+    }
+    return head_sector_;
+}
+
+esp_err_t TsLog::start_sector(uint32_t timestamp, const int32_t (&values)[TSLOG_CHANNELS])
+{
+    uint32_t sector = has_head_ ? (head_sector_ + 1) % sector_count_ : 0;
+    uint32_t seq = has_head_ ? head_seq_ + 1 : 0;
+
+    esp_err_t err = esp_partition_erase_range(partition_, sector * SECTOR_SIZE, SECTOR_SIZE);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Erase of sector %lu failed: %s", (unsigned long)sector, esp_err_to_name(err));
+        return err;
+    }
+
+    TsSectorHeader h = {};
+    h.magic = MAGIC;
+    h.seq = seq;
+    h.base_time = timestamp;
+    memcpy(h.base, values, sizeof(h.base));
+    h.crc = header_crc(h);
+    err = esp_partition_write(partition_, sector * SECTOR_SIZE, &h, sizeof(h));
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    has_head_ = true;
+    head_sector_ = sector;
+    head_seq_ = seq;
+    head_index_ = 0;
+    return ESP_OK;
+}
+
+esp_err_t TsLog::append(uint32_t timestamp, const int32_t (&values)[TSLOG_CHANNELS])
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!map_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    bool fits = has_head_ && head_index_ < RECORDS_PER_SECTOR;
+    const TsSectorHeader *h = has_head_ ? header(head_sector_) : nullptr;
+    TsRecord rec = {};
+    if (fits)
+    {
+        fits = timestamp >= h->base_time && timestamp - h->base_time < 0xFFFF;
+        rec.dt = static_cast<uint16_t>(timestamp - h->base_time);
+        for (size_t i = 0; fits && i < TSLOG_CHANNELS; i++)
+        {
+            int64_t delta = static_cast<int64_t>(values[i]) - h->base[i];
+            fits = delta >= INT16_MIN && delta <= INT16_MAX;
+            rec.dv[i] = static_cast<int16_t>(delta);
+        }
+    }
+
+    if (!fits)
+    {
+        // New base: the sample becomes the sector header and record 0 is an all-zero delta
+        esp_err_t err = start_sector(timestamp, values);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        rec = {};
+    }
+
+    rec.crc = record_crc(rec);
+    size_t offset = head_sector_ * SECTOR_SIZE + sizeof(TsSectorHeader) + head_index_ * sizeof(TsRecord);
+    esp_err_t err = esp_partition_write(partition_, offset, &rec, sizeof(rec));
+    // The slot is used even if the write failed half way; readers skip it by its CRC
+    head_index_++;
+    return err;
+}
+
+esp_err_t TsLog::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!map_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t err = esp_partition_erase_range(partition_, 0, sector_count_ * SECTOR_SIZE);
+    has_head_ = false;
+    head_sector_ = 0;
+    head_index_ = 0;
+    return err;
+}
+
+TsLogCursor TsLog::oldest() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!map_ || !has_head_)
+    {
+        return TsLogCursor(this, 0, ERASED_SEQ);
+    }
+    uint32_t sector = oldest_sector();
+    return TsLogCursor(this, sector, header(sector)->seq);
+}
+
+TsLogCursor TsLog::since(uint32_t timestamp) const
+{
+    TsLogCursor cursor = oldest();
+    if (cursor.seq_ == ERASED_SEQ)
+    {
+        return cursor;
+    }
+
+    // Skip whole sectors while the following sector still starts at or before timestamp
+    for (;;)
+    {
+        uint32_t next = (cursor.sector_ + 1) % sector_count_;
+        if (!header_valid(next) || header(next)->seq != cursor.seq_ + 1 || header(next)->base_time > timestamp)
+            break;
+        cursor.sector_ = next;
+        cursor.seq_++;
+    }
+
+    TsSample sample;
+    for (;;)
+    {
+        TsLogCursor probe = cursor;
+        if (!probe.next(sample) || sample.timestamp >= timestamp)
+            break;
+        cursor = probe;
+    }
+    return cursor;
+}
+
+bool TsLogCursor::next(TsSample &sample)
+{
+    if (!log_ || !log_->map_)
+    {
+        return false;
+    }
+    if (seq_ == TsLog::ERASED_SEQ)
+    {
+        // Log was empty when the cursor was created
+        TsLogCursor start = log_->oldest();
+        if (start.seq_ == TsLog::ERASED_SEQ)
+            return false;
+        *this = start;
+    }
+
+    for (;;)
+    {
+        const TsSectorHeader *h = log_->header(sector_);
+        if (!log_->header_valid(sector_) || h->seq != seq_)
+        {
+            // The writer wrapped around and erased this sector, continue with the oldest data
+            TsLogCursor start = log_->oldest();
+            if (start.seq_ == TsLog::ERASED_SEQ || start.seq_ == seq_)
+                return false;
+            *this = start;
+            continue;
+        }
+
+        if (index_ < TsLog::RECORDS_PER_SECTOR)
+        {
+            const TsRecord *rec = log_->record(sector_, index_);
+            if (!TsLog::record_free(rec))
+            {
+                index_++;
+                if (!TsLog::record_valid(rec))
+                    continue;
+                sample.timestamp = h->base_time + rec->dt;
+                for (size_t i = 0; i < TSLOG_CHANNELS; i++)
+                    sample.values[i] = h->base[i] + rec->dv[i];
+                return true;
+            }
+        }
+
+        // End of this sector's data: move on only if the writer already started the next one
+        uint32_t next = (sector_ + 1) % log_->sector_count_;
+        if (!log_->header_valid(next) || log_->header(next)->seq != seq_ + 1)
+            return false;
+        sector_ = next;
+        seq_++;
+        index_ = 0;
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+static constexpr size_t UPLINK_MAX_CHANNELS = CONFIG_HV_UPLINK_MAX_CHANNELS;
+static constexpr uint16_t UPLINK_FRAME_MAGIC = 0x5548; // "HU"
+static constexpr uint16_t UPLINK_ACK_MAGIC = 0x4148;   // "HA"
+static constexpr uint8_t UPLINK_VERSION = 1;
+static constexpr size_t UPLINK_HEADER_SIZE = 18;
+static constexpr size_t UPLINK_ACK_SIZE = 8;
+
+// Counters since start() or reset_stats()
+struct UplinkStats
+{
+    uint32_t samples;       // accepted by add()
+    uint32_t frames;        // frames closed
+    uint32_t bytes_sent;    // UDP payload bytes including retransmissions
+    uint32_t datagrams;     // sendto() calls including retransmissions
+    uint32_t retransmits;
+    uint32_t acked;
+    uint32_t dropped;       // oldest frame discarded because the window was full
+    uint32_t lost;          // not acknowledged after CONFIG_HV_UPLINK_MAX_TRIES sends
+    uint32_t rtt_ms;        // round trip of the last acknowledged frame
+};
+
+/**
+ * @brief Batched sample uplink over UDP
+ *
+ * Samples are encoded into compact frames as they are added: the first sample of a frame
+ * holds absolute values, every further one the time and value deltas to its predecessor,
+ * all as zigzag varints. A frame is closed when the next sample would exceed
+ * CONFIG_HV_UPLINK_MAX_FRAME bytes or CONFIG_HV_UPLINK_FLUSH_MS after its first sample.
+ *
+ * Frame layout (little endian):
+ *
+ *     u16 magic "HU", u8 version, u8 channels, u32 device_id, u32 seq,
+ *     u32 base_time, u8 count, u8 reserved,
+ *     count × (varint dt, channels × zigzag varint dv),
+ *     u32 CRC32 over everything before it
+ *
+ * The receiver answers every frame with u16 magic "HA", u8 version, u8 reserved, u32 seq.
+ * Unacknowledged frames are sent again every CONFIG_HV_UPLINK_RETRY_MS, up to
+ * CONFIG_HV_UPLINK_WINDOW frames are kept. Nothing is sent while Wi-Fi is not connected.
+ */
+class Uplink
+{
+public:
+    static Uplink &getInstance()
+    {
+        static Uplink instance;
+        return instance;
+    }
+
+    Uplink(const Uplink &) = delete;
+    Uplink &operator=(const Uplink &) = delete;
+
+    // host may be an IPv4 address or a name, it is resolved once Wi-Fi is connected
+    esp_err_t start(const std::string &host, uint16_t port, uint32_t device_id, size_t channels);
+
+    // Timestamp in seconds, values in fixed point as chosen by the application
+    esp_err_t add(uint32_t timestamp, const int32_t *values);
+    // Closes the current frame and sends it without waiting for the time limit
+    esp_err_t flush();
+    // Blocks until every closed frame was acknowledged or given up
+    esp_err_t wait_sent(TickType_t timeout = portMAX_DELAY);
+
+    UplinkStats get_stats() const;
+    void reset_stats();
+
+private:
+    struct Frame
+    {
+        uint32_t seq;
+        uint8_t tries;
+        int64_t sent_us;
+        std::vector<uint8_t> data;
+    };
+
+    static constexpr const char *TAG = "hv-uplink";
+
+    Uplink()
+        : task_(nullptr), flush_timer_(nullptr), sock_(-1), addr_(0), port_(0), device_id_(0), channels_(0), next_seq_(0),
+          open_len_(0), open_count_(0), open_time_(0), prev_time_(0), prev_{}, stats_{}
+    {
+    }
+
+    void open_frame(uint32_t timestamp);
+    size_t encode_sample(uint8_t *out, uint32_t timestamp, const int32_t *values) const;
+    void close_frame_locked();
+    bool resolve();
+    void send_due(int64_t now_us);
+    void receive_acks();
+    int64_t next_deadline_us() const;
+
+    static void uplink_task(void *arg);
+    static void flush_timer_cb(void *arg);
+
+    TaskHandle_t task_;
+    esp_timer_handle_t flush_timer_;
+    int sock_;
+    std::string host_;
+    uint32_t addr_; // IPv4 address in network byte order, 0 = not resolved yet
+    uint16_t port_;
+    uint32_t device_id_;
+    size_t channels_;
+    uint32_t next_seq_;
+
+    // Frame being filled
+    std::vector<uint8_t> open_;
+    size_t open_len_; // 0 = no open frame
+    uint8_t open_count_;
+    uint32_t open_time_;
+    uint32_t prev_time_;
+    int32_t prev_[UPLINK_MAX_CHANNELS];
+
+    std::vector<Frame> window_; // closed frames waiting for their acknowledgement, oldest first
+    UplinkStats stats_;
+    mutable std::mutex mutex_;
+    std::condition_variable sent_cv_;
+};
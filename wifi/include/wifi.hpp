@@ -2,10 +2,155 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include <string>
+#include <string_view>
 #include <mutex>
 #include "esp_err.h"
 #include "freertos/event_groups.h"
 #include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "sdkconfig.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <sys/time.h>
+#include <vector>
+
+enum class WifiState : uint8_t
+{
+    IDLE,       // not started, or stopped with stop()
+    CONNECTING, // scan, association or DHCP in progress
+    CONNECTED,  // got an IP address
+    BACKOFF,    // waiting before the next connection attempt
+};
+
+const char *wifi_state_name(WifiState state);
+
+enum class WifiClockSource : uint8_t
+{
+    NONE, // clock not set
+    NVS,  // set to the last sync time after a power loss, only a lower bound
+    RTC,  // kept across deep sleep or reset since the last sync
+    SNTP, // synced in this boot
+};
+
+const char *wifi_clock_source_name(WifiClockSource source);
+
+struct WifiClockInfo
+{
+    WifiClockSource source;
+    int64_t last_sync_us; // epoch of the last SNTP sync in microseconds, 0 = never
+    float drift_ppm;      // RTC clock rate error, positive = local clock fast
+    bool drift_valid;     // needs two syncs at least 10 minutes apart
+    uint32_t interval_s;  // current resync interval
+};
+
+static constexpr size_t WIFI_RSSI_HISTORY_LEN = CONFIG_HV_WIFI_RSSI_HISTORY_LEN;
+static constexpr size_t WIFI_DISCONNECT_HISTORY_LEN = 8;
+
+struct WifiDisconnect
+{
+    int64_t time_us;      // esp_timer_get_time() of the event
+    uint32_t connected_s; // duration of the lost connection, 0 for a failed attempt
+    uint8_t reason;       // wifi_err_reason_t
+    int8_t rssi;
+};
+
+// Link statistics since boot or reset_stats()
+struct WifiStats
+{
+    uint32_t attempts;        // association attempts
+    uint32_t failed_attempts; // attempts that ended without an IP address
+    uint32_t connects;        // got an IP address
+    uint32_t fast_connects;   // of those, via the cached AP
+    uint32_t links_lost;      // disconnects after got IP
+
+    // Phases of the last successful connect
+    uint32_t assoc_ms;       // attempt start to associated
+    uint32_t dhcp_ms;        // associated to got IP
+    uint32_t connect_ms;     // start() or link loss to got IP, including retries and backoff
+    uint32_t connect_ms_max;
+    uint64_t connect_ms_sum; // average = connect_ms_sum / connects
+
+    uint32_t uptime_s;       // current connection, 0 if not connected
+    uint32_t longest_uptime_s;
+    uint64_t total_uptime_s; // all connections including the current one
+
+    WifiDisconnect disconnects[WIFI_DISCONNECT_HISTORY_LEN]; // oldest first
+    uint8_t disconnect_count;
+    int8_t rssi[WIFI_RSSI_HISTORY_LEN]; // sampled every CONFIG_HV_WIFI_RSSI_SAMPLE_S while connected, oldest first
+    uint8_t rssi_count;
+};
+
+// Called on every state change, from the event loop or esp_timer task. Keep it short
+// and do not block; it is called without the Wifi mutex held.
+using WifiObserver = std::function<void(WifiState from, WifiState to)>;
+
+static constexpr size_t WIFI_MAX_NETWORKS = CONFIG_HV_WIFI_MAX_NETWORKS;
+
+// One stored network of the credential list
+struct WifiNetwork
+{
+    char ssid[33];
+    char password[65];
+    int8_t priority; // higher is preferred, RSSI and success history decide between equal priorities
+};
+
+struct WifiNetworkInfo
+{
+    std::string ssid;
+    int8_t priority;
+    uint16_t successes; // aged: both counts are halved when their sum exceeds 64
+    uint16_t failures;
+    bool legacy;        // the wifi_ssid / wifi_password pair of the "config" namespace
+};
+
+enum class WifiPowerProfile : uint8_t
+{
+    PERFORMANCE, // no power save, lowest latency and highest throughput
+    BALANCED,    // modem sleep, wakes for every DTIM beacon
+    AGGRESSIVE,  // modem sleep, wakes every CONFIG_HV_WIFI_LISTEN_INTERVAL beacons
+};
+
+static constexpr size_t WIFI_POWER_PROFILE_COUNT = 3;
+
+#if CONFIG_HV_WIFI_POWER_PERFORMANCE
+static constexpr WifiPowerProfile WIFI_DEFAULT_POWER_PROFILE = WifiPowerProfile::PERFORMANCE;
+#elif CONFIG_HV_WIFI_POWER_AGGRESSIVE
+static constexpr WifiPowerProfile WIFI_DEFAULT_POWER_PROFILE = WifiPowerProfile::AGGRESSIVE;
+#else
+static constexpr WifiPowerProfile WIFI_DEFAULT_POWER_PROFILE = WifiPowerProfile::BALANCED;
+#endif
+
+const char *wifi_power_profile_name(WifiPowerProfile profile);
+
+// Per profile, since boot or reset_power_stats()
+struct WifiPowerStats
+{
+    uint64_t active_ms;      // time in effect between start() and stop()
+    uint32_t entered;        // switches to this profile
+    uint32_t transfers;      // record_transfer() calls while in effect
+    uint64_t bytes;          // throughput = bytes / active_ms
+    uint64_t latency_us_sum; // average = latency_us_sum / transfers
+    uint32_t latency_us_max;
+};
+
+// Called when the profile in effect changes, e.g. to mark a power trace. Same rules as
+// WifiObserver: short, non-blocking, called without the Wifi mutex held.
+using WifiPowerHook = std::function<void(WifiPowerProfile from, WifiPowerProfile to)>;
+
+// Last successful association, cached in NVS for a targeted reconnect
+struct WifiFastConnect
+{
+    char ssid[33];     // the cache is ignored when the configured SSID differs
+    uint8_t bssid[6];
+    uint8_t channel;   // 0 = no cached AP
+    uint32_t ip;       // IPv4 lease, network byte order, 0 = none
+    uint32_t netmask;
+    uint32_t gw;
+    uint32_t dns;
+};
 
 class Wifi
 {
@@ -15,14 +160,135 @@ private:
     std::string wifi_ssid;
     std::string wifi_password;
     std::string hostname_;
-    bool is_connected;
+    std::atomic<WifiState> state_;
+    bool initialized_;
+    esp_timer_handle_t backoff_timer_;
+
+    EventGroupHandle_t time_event_group_;
+    esp_timer_handle_t sntp_timer_;
+    WifiClockSource clock_source_;
+
+    WifiStats stats_;        // rings in raw order, rotated by get_stats()
+    size_t disconnect_head_;
+    size_t rssi_head_;
+    int64_t cycle_start_us_; // start() or link loss
+    int64_t attempt_start_us_;
+    int64_t assoc_us_;
+    int64_t connected_us_;   // got IP, 0 while not connected
+    esp_timer_handle_t rssi_timer_;
+
+    std::mutex observer_mutex_;
+    std::vector<std::pair<int, WifiObserver>> observers_;
+    int next_observer_id_;
+
+    esp_netif_t *netif_;
+    WifiFastConnect fast_cache_;   // as loaded from NVS
+    bool fast_attempt_;            // targeted connect to the cached AP in progress
+    bool static_ip_;               // cached lease applied instead of DHCP
+    uint8_t ap_bssid_[6];          // AP of the current association
+    uint8_t ap_channel_;
+
+    // Credential list and ranked candidates of the current connection cycle
+    struct NetEntry
+    {
+        WifiNetwork net;
+        size_t slot; // NVS slot, WIFI_MAX_NETWORKS for the legacy "config" pair
+    };
+    struct Candidate
+    {
+        size_t net; // index into networks_
+        uint8_t bssid[6];
+        uint8_t channel;
+        int8_t rssi;
+        int score;
+    };
+    struct NetHistory
+    {
+        uint16_t successes;
+        uint16_t failures;
+    };
+    struct HistoryRecord
+    {
+        NetHistory nets[WIFI_MAX_NETWORKS + 1]; // by slot
+        uint8_t last_ok;                        // slot of the last successful connect
+        uint8_t reserved[3];
+    };
+    std::vector<NetEntry> networks_;
+    std::vector<Candidate> candidates_;
+    size_t cand_pos_;
+    int cand_attempts_;
+    size_t current_net_;
+    bool scanning_;
+    HistoryRecord history_;
+    bool history_dirty_;
+
+    // Power save
+    WifiPowerProfile power_profile_; // selected with set_power_profile()
+    WifiPowerProfile power_active_;  // in effect, PERFORMANCE during a burst
+    int burst_count_;
+    bool burst_hold_;                // burst ended, back to power_profile_ when burst_timer_ fires
+    esp_timer_handle_t burst_timer_;
+    int64_t power_since_us_;         // start of the current profile period, 0 while stopped
+    WifiPowerStats power_stats_[WIFI_POWER_PROFILE_COUNT];
+    WifiPowerHook power_hook_;       // guarded by observer_mutex_
 
     mutable std::mutex mutex_;
 
-    Wifi() : s_wifi_event_group_(nullptr), s_retry_num_(0), wifi_ssid("unset"), wifi_password("unset"), is_connected(false)
+    Wifi() : s_wifi_event_group_(nullptr), s_retry_num_(0), wifi_ssid("unset"), wifi_password("unset"),
+             state_(WifiState::IDLE), initialized_(false), backoff_timer_(nullptr), time_event_group_(nullptr),
+             sntp_timer_(nullptr), clock_source_(WifiClockSource::NONE), stats_{}, disconnect_head_(0), rssi_head_(0),
+             cycle_start_us_(0), attempt_start_us_(0), assoc_us_(0), connected_us_(0), rssi_timer_(nullptr),
+             next_observer_id_(0), netif_(nullptr), fast_cache_{}, fast_attempt_(false), static_ip_(false), ap_bssid_{}, ap_channel_(0),
+             cand_pos_(0), cand_attempts_(0), current_net_(0), scanning_(false), history_{}, history_dirty_(false),
+             power_profile_(WIFI_DEFAULT_POWER_PROFILE), power_active_(WIFI_DEFAULT_POWER_PROFILE), burst_count_(0),
+             burst_hold_(false), burst_timer_(nullptr), power_since_us_(0), power_stats_{}
     {
     }
 
+    void load_fast_connect();
+    void apply_fast_connect(wifi_config_t &wifi_config);
+    void fall_back_to_scan();
+    void save_fast_connect(const esp_netif_ip_info_t &ip_info);
+
+    void load_networks();
+    void sta_config(wifi_config_t &wifi_config, const WifiNetwork &net) const;
+    // Connects to the current candidate, or scans first when no candidate is left
+    void next_attempt();
+    void start_scan();
+    void rank_candidates();
+    void connect_candidate();
+    void record_result(bool success);
+    void save_history();
+    // Arms the backoff timer after a failed cycle, returns the new state
+    WifiState schedule_retry(uint8_t reason);
+
+    esp_err_t init_driver();
+    uint32_t backoff_delay_ms(int attempt) const;
+    void notify(WifiState from, WifiState to);
+    static void backoff_timer_cb(void *arg);
+
+    // Starts an association attempt and records it in the statistics
+    void connect_attempt();
+    void stats_associated();
+    void stats_got_ip();
+    void stats_disconnected(uint8_t reason, int8_t rssi);
+    static void rssi_timer_cb(void *arg);
+
+    // Switches the driver to profile, returns false if it was already in effect
+    bool apply_power_locked(WifiPowerProfile profile, WifiPowerProfile &from);
+    void account_power_locked(int64_t now_us);
+    // Applies the profile in effect to the driver and starts / ends time accounting
+    void start_power_locked(int64_t now_us);
+    void stop_power_locked(int64_t now_us);
+    void notify_power(WifiPowerProfile from, WifiPowerProfile to);
+    static void burst_timer_cb(void *arg);
+
+    void restore_clock();
+    void start_sntp();
+    bool time_sync_due_locked() const;
+    static void sntp_sync_cb(struct timeval *tv);
+    static void sntp_timer_cb(void *arg);
+
 public:
     // Delete copy constructor and assignment operator
     Wifi(const Wifi &) = delete;
@@ -36,14 +302,63 @@ public:
     }
 
     bool get_is_connected() {
-        return is_connected;
+        return state_.load() == WifiState::CONNECTED;
     }
+    WifiState get_state() const { return state_.load(); }
 
     void set_hostname(const std::string &hostname) { hostname_ = hostname; }
+    // Starts connecting and returns immediately. Failed attempts and lost connections
+    // are retried with exponential backoff until stop() is called.
+    esp_err_t start(void);
+    // Disconnects and stops retrying, the state becomes IDLE
+    esp_err_t stop(void);
+    // Blocks until connected, or until CONFIG_HV_WIFI_MAX_RETRY attempts failed or
+    // timeout expired. Retrying continues in the background in both failure cases.
+    // Past the retry limit, a call made during a later attempt waits for that attempt.
+    esp_err_t wait_connected(TickType_t timeout = portMAX_DELAY);
+    // start() followed by wait_connected()
     esp_err_t wifi_connect(void);
+
+    // Returns an id for remove_observer()
+    int add_observer(WifiObserver observer);
+    void remove_observer(int id);
+    // Drop the cached AP and lease, the next connect does a full scan
+    esp_err_t forget_fast_connect();
+
+    // Credential list in the "wifi_nets" namespace, used from the next start() on.
+    // add_network() replaces an entry with the same SSID.
+    esp_err_t add_network(std::string_view ssid, std::string_view password, int8_t priority = 0);
+    esp_err_t remove_network(std::string_view ssid);
+    std::vector<WifiNetworkInfo> get_networks() const;
     static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                                    int32_t event_id, void *event_data);
-    esp_err_t time_sync(void);
+    // Restores the clock from RTC memory or NVS and starts SNTP in the background if a
+    // sync is due, or with force. Returns immediately; the resync interval adapts to the
+    // measured drift of the RTC clock. Starts NvsAsyncWriter, which stores the synced state.
+    esp_err_t time_sync(bool force = false);
+    // Blocks until the clock is synced, or was recent enough that no sync was needed
+    esp_err_t wait_time_sync(TickType_t timeout = portMAX_DELAY);
+    bool time_sync_due() const;
+    WifiClockInfo get_clock_info() const;
+
+    // The power save mode changes at once, the listen interval of AGGRESSIVE with the next
+    // association. During a burst the new profile takes effect when the burst ends.
+    esp_err_t set_power_profile(WifiPowerProfile profile);
+    WifiPowerProfile get_power_profile() const;        // as selected
+    WifiPowerProfile get_active_power_profile() const; // in effect
+    // Switch to PERFORMANCE for a burst of traffic. Nested calls are counted; the selected
+    // profile returns CONFIG_HV_WIFI_BURST_HOLD_MS after the last end_burst().
+    void begin_burst();
+    void end_burst();
+    // Measurement hook: one completed transfer, counted for the profile in effect
+    void record_transfer(size_t bytes, uint32_t latency_us);
+    void set_power_hook(WifiPowerHook hook);
+    WifiPowerStats get_power_stats(WifiPowerProfile profile) const;
+    void reset_power_stats();
+
+    WifiStats get_stats() const;
+    void reset_stats();
+    void log_stats() const;
     std::string get_wifi_ssid()
     {
         return wifi_ssid;
@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""Receiver for the frames sent by Uplink (wifi/uplink.cpp).
+
+Stands in for the backend during development: decodes every frame, acknowledges it,
+drops duplicates of retransmitted frames and prints the samples or appends them to a
+CSV file. --loss drops a share of the incoming frames to exercise the retransmission.
+
+    python3 uplink_sink.py --port 47000 --csv samples.csv --loss 0.2
+"""
+
+import argparse
+import csv
+import random
+import socket
+import struct
+import sys
+import time
+import zlib
+
+FRAME_MAGIC = 0x5548  # "HU"
+ACK_MAGIC = 0x4148  # "HA"
+VERSION = 1
+HEADER = struct.Struct("<HBBIIIBB")
+
+
+def read_varint(data, pos):
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(data):
+            raise ValueError("truncated varint")
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return value, pos
+        shift += 7
+
+
+def unzigzag(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+def to_int32(value):
+    value &= 0xFFFFFFFF
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def decode(data):
+    """Returns (device_id, seq, [(timestamp, [values])]) or raises ValueError."""
+    if len(data) < HEADER.size + 4:
+        raise ValueError("short frame")
+    # esp_rom_crc32_le(0, ...) is the standard CRC-32 as computed by zlib
+    (crc,) = struct.unpack_from("<I", data, len(data) - 4)
+    if zlib.crc32(data[:-4]) != crc:
+        raise ValueError("bad CRC")
+    magic, version, channels, device_id, seq, base_time, count, _ = HEADER.unpack_from(data)
+    if magic != FRAME_MAGIC or version != VERSION:
+        raise ValueError("unknown frame")
+
+    samples = []
+    pos = HEADER.size
+    timestamp = base_time
+    values = [0] * channels
+    for _ in range(count):
+        dt, pos = read_varint(data, pos)
+        timestamp += dt
+        for i in range(channels):
+            dv, pos = read_varint(data, pos)
+            values[i] = to_int32(values[i] + unzigzag(dv))
+        samples.append((timestamp, list(values)))
+    if pos != len(data) - 4:
+        raise ValueError("trailing bytes")
+    return device_id, seq, samples
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=47000)
+    parser.add_argument("--csv", help="append samples to this file instead of printing them")
+    parser.add_argument("--loss", type=float, default=0.0, help="share of frames to drop, 0..1")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    print(f"listening on {args.bind}:{args.port}", file=sys.stderr)
+
+    out = None
+    if args.csv:
+        out = csv.writer(open(args.csv, "a", newline=""))
+
+    seen = {}  # device_id -> recently received sequence numbers
+    frames = duplicates = dropped = 0
+    while True:
+        data, addr = sock.recvfrom(2048)
+        if random.random() < args.loss:
+            dropped += 1
+            continue
+        try:
+            device_id, seq, samples = decode(data)
+        except ValueError as err:
+            print(f"{addr[0]}: {err}", file=sys.stderr)
+            continue
+
+        # Acknowledge duplicates too, the first acknowledgement may have been lost
+        sock.sendto(struct.pack("<HBBI", ACK_MAGIC, VERSION, 0, seq), addr)
+        recent = seen.setdefault(device_id, [])
+        if seq in recent:
+            duplicates += 1
+            continue
+        recent.append(seq)
+        del recent[:-256]
+        frames += 1
+
+        for timestamp, values in samples:
+            if out:
+                out.writerow([device_id, timestamp] + values)
+            else:
+                stamp = time.strftime("%Y-%m-%d %H:%M:%S", time.localtime(timestamp))
+                print(f"{device_id:08x} #{seq} {stamp} {values}")
+        print(f"frame {seq} from {device_id:08x}: {len(samples)} samples in {len(data)} bytes "
+              f"(frames {frames}, duplicates {duplicates}, dropped {dropped})", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,431 @@
+#include "uplink.hpp"
+#include "wifi.hpp"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "lwip/netdb.h"
+#include "lwip/sockets.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (v >> (8 * i)) & 0xFF;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static size_t put_varint(uint8_t *p, uint32_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        p[n++] = static_cast<uint8_t>(v) | 0x80;
+        v >>= 7;
+    }
+    p[n++] = static_cast<uint8_t>(v);
+    return n;
+}
+
+// Maps small negative and positive deltas to small unsigned numbers
+static uint32_t zigzag(int32_t v)
+{
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+esp_err_t Uplink::start(const std::string &host, uint16_t port, uint32_t device_id, size_t channels)
+{
+    if (channels == 0 || channels > UPLINK_MAX_CHANNELS || host.empty())
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (task_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    host_ = host;
+    port_ = port;
+    device_id_ = device_id;
+    channels_ = channels;
+    open_.resize(CONFIG_HV_UPLINK_MAX_FRAME);
+    window_.reserve(CONFIG_HV_UPLINK_WINDOW);
+
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = &flush_timer_cb;
+    timer_args.arg = this;
+    timer_args.name = "uplink_flush";
+    esp_err_t err = esp_timer_create(&timer_args, &flush_timer_);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    if (xTaskCreate(uplink_task, "uplink", CONFIG_HV_UPLINK_TASK_STACK_SIZE, this, CONFIG_HV_UPLINK_TASK_PRIORITY,
+                    &task_) != pdPASS)
+    {
+        task_ = nullptr;
+        esp_timer_delete(flush_timer_);
+        flush_timer_ = nullptr;
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Frames collected while offline go out as soon as the link is back
+    TaskHandle_t task = task_;
+    Wifi::getInstance().add_observer([task](WifiState, WifiState to)
+                                     {
+        if (to == WifiState::CONNECTED)
+            xTaskNotifyGive(task); });
+    return ESP_OK;
+}
+
+void Uplink::open_frame(uint32_t timestamp)
+{
+    uint8_t *p = open_.data();
+    put_u16(p, UPLINK_FRAME_MAGIC);
+    p[2] = UPLINK_VERSION;
+    p[3] = static_cast<uint8_t>(channels_);
+    put_u32(p + 4, device_id_);
+    put_u32(p + 8, next_seq_++);
+    put_u32(p + 12, timestamp);
+    p[16] = 0; // count, set when the frame is closed
+    p[17] = 0;
+    open_len_ = UPLINK_HEADER_SIZE;
+    open_count_ = 0;
+    open_time_ = timestamp;
+
+    // The first sample is encoded as delta to base_time and zero
+    prev_time_ = timestamp;
+    memset(prev_, 0, sizeof(prev_));
+}
+
+size_t Uplink::encode_sample(uint8_t *out, uint32_t timestamp, const int32_t *values) const
+{
+    size_t n = put_varint(out, timestamp - prev_time_);
+    for (size_t i = 0; i < channels_; i++)
+    {
+        // Wrapping difference, the receiver adds it back modulo 2^32
+        int32_t delta = static_cast<int32_t>(static_cast<uint32_t>(values[i]) - static_cast<uint32_t>(prev_[i]));
+        n += put_varint(out + n, zigzag(delta));
+    }
+    return n;
+}
+
+esp_err_t Uplink::add(uint32_t timestamp, const int32_t *values)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!task_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint8_t sample[5 * (1 + UPLINK_MAX_CHANNELS)];
+    if (open_len_ == 0)
+    {
+        open_frame(timestamp);
+    }
+    size_t n = encode_sample(sample, timestamp, values);
+    if (open_count_ > 0 &&
+        (open_len_ + n + sizeof(uint32_t) > CONFIG_HV_UPLINK_MAX_FRAME || open_count_ == UINT8_MAX || timestamp < prev_time_))
+    {
+        close_frame_locked();
+        open_frame(timestamp);
+        n = encode_sample(sample, timestamp, values);
+    }
+
+    memcpy(open_.data() + open_len_, sample, n);
+    open_len_ += n;
+    if (open_count_++ == 0)
+    {
+        esp_timer_start_once(flush_timer_, static_cast<uint64_t>(CONFIG_HV_UPLINK_FLUSH_MS) * 1000);
+    }
+    prev_time_ = timestamp;
+    memcpy(prev_, values, channels_ * sizeof(int32_t));
+    stats_.samples++;
+    return ESP_OK;
+}
+
+void Uplink::close_frame_locked()
+{
+    if (open_len_ == 0)
+    {
+        return;
+    }
+    esp_timer_stop(flush_timer_);
+
+    uint8_t *p = open_.data();
+    p[16] = open_count_;
+    put_u32(p + open_len_, esp_rom_crc32_le(0, p, open_len_));
+    open_len_ += sizeof(uint32_t);
+
+    if (window_.size() >= CONFIG_HV_UPLINK_WINDOW)
+    {
+        ESP_LOGW(TAG, "Window full, dropping frame %lu", (unsigned long)window_.front().seq);
+        window_.erase(window_.begin());
+        stats_.dropped++;
+    }
+    Frame frame;
+    frame.seq = get_u32(p + 8);
+    frame.tries = 0;
+    frame.sent_us = 0;
+    frame.data.assign(p, p + open_len_);
+    window_.push_back(std::move(frame));
+    stats_.frames++;
+    open_len_ = 0;
+    xTaskNotifyGive(task_);
+}
+
+esp_err_t Uplink::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!task_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    close_frame_locked();
+    return ESP_OK;
+}
+
+esp_err_t Uplink::wait_sent(TickType_t timeout)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!task_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    auto done = [this]
+    { return window_.empty(); };
+    if (timeout == portMAX_DELAY)
+    {
+        sent_cv_.wait(lock, done);
+        return ESP_OK;
+    }
+    return sent_cv_.wait_for(lock, std::chrono::milliseconds(pdTICKS_TO_MS(timeout)), done) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+UplinkStats Uplink::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void Uplink::reset_stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = {};
+}
+
+void Uplink::flush_timer_cb(void *arg)
+{
+    auto *uplink = static_cast<Uplink *>(arg);
+    std::lock_guard<std::mutex> lock(uplink->mutex_);
+    uplink->close_frame_locked();
+}
+
+bool Uplink::resolve()
+{
+    if (sock_ < 0)
+    {
+        sock_ = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+        if (sock_ < 0)
+        {
+            ESP_LOGE(TAG, "Failed to create socket: errno %d", errno);
+            return false;
+        }
+    }
+    if (addr_ != 0)
+    {
+        return true;
+    }
+
+    struct in_addr addr;
+    if (inet_pton(AF_INET, host_.c_str(), &addr) == 1)
+    {
+        addr_ = addr.s_addr;
+        return true;
+    }
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo *res = nullptr;
+    if (getaddrinfo(host_.c_str(), nullptr, &hints, &res) != 0 || !res)
+    {
+        ESP_LOGW(TAG, "Cannot resolve %s", host_.c_str());
+        return false;
+    }
+    addr_ = reinterpret_cast<struct sockaddr_in *>(res->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(res);
+    return true;
+}
+
+int64_t Uplink::next_deadline_us() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    int64_t deadline = -1;
+    for (const Frame &frame : window_)
+    {
+        int64_t due = frame.tries == 0 ? 0 : frame.sent_us + CONFIG_HV_UPLINK_RETRY_MS * 1000LL;
+        if (deadline < 0 || due < deadline)
+            deadline = due;
+    }
+    return deadline;
+}
+
+void Uplink::send_due(int64_t now_us)
+{
+    std::vector<std::vector<uint8_t>> due;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = window_.begin(); it != window_.end();)
+        {
+            if (it->tries > 0 && now_us - it->sent_us < CONFIG_HV_UPLINK_RETRY_MS * 1000LL)
+            {
+                ++it;
+                continue;
+            }
+            if (it->tries >= CONFIG_HV_UPLINK_MAX_TRIES)
+            {
+                ESP_LOGW(TAG, "Frame %lu not acknowledged, giving up", (unsigned long)it->seq);
+                it = window_.erase(it);
+                stats_.lost++;
+                continue;
+            }
+            if (it->tries > 0)
+                stats_.retransmits++;
+            it->tries++;
+            it->sent_us = now_us;
+            due.push_back(it->data);
+            ++it;
+        }
+        if (window_.empty())
+            sent_cv_.notify_all();
+    }
+
+    struct sockaddr_in dest = {};
+    dest.sin_family = AF_INET;
+    dest.sin_port = htons(port_);
+    dest.sin_addr.s_addr = addr_;
+    for (const auto &data : due)
+    {
+        int sent = sendto(sock_, data.data(), data.size(), 0, reinterpret_cast<struct sockaddr *>(&dest), sizeof(dest));
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (sent < 0)
+        {
+            ESP_LOGW(TAG, "sendto failed: errno %d", errno);
+            continue;
+        }
+        stats_.datagrams++;
+        stats_.bytes_sent += sent;
+    }
+}
+
+void Uplink::receive_acks()
+{
+    uint8_t buf[16];
+    for (;;)
+    {
+        int len = recvfrom(sock_, buf, sizeof(buf), MSG_DONTWAIT, nullptr, nullptr);
+        if (len < 0)
+        {
+            return;
+        }
+        if (len != UPLINK_ACK_SIZE || buf[0] != (UPLINK_ACK_MAGIC & 0xFF) || buf[1] != (UPLINK_ACK_MAGIC >> 8) ||
+            buf[2] != UPLINK_VERSION)
+        {
+            continue;
+        }
+        uint32_t seq = get_u32(buf + 4);
+        int64_t now = esp_timer_get_time();
+
+        size_t bytes = 0;
+        int64_t rtt_us = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto it = window_.begin(); it != window_.end(); ++it)
+            {
+                if (it->seq == seq && it->tries > 0)
+                {
+                    rtt_us = now - it->sent_us;
+                    bytes = it->data.size();
+                    stats_.rtt_ms = static_cast<uint32_t>(rtt_us / 1000);
+                    stats_.acked++;
+                    window_.erase(it);
+                    break;
+                }
+            }
+            if (window_.empty())
+                sent_cv_.notify_all();
+        }
+        if (bytes > 0)
+        {
+            // Latency and throughput per Wi-Fi power profile
+            Wifi::getInstance().record_transfer(bytes, static_cast<uint32_t>(rtt_us));
+        }
+    }
+}
+
+void Uplink::uplink_task(void *arg)
+{
+    auto *uplink = static_cast<Uplink *>(arg);
+    auto &wifi = Wifi::getInstance();
+    bool burst = false;
+
+    for (;;)
+    {
+        int64_t deadline = uplink->next_deadline_us();
+        if (deadline < 0 || !wifi.get_is_connected())
+        {
+            if (burst)
+            {
+                wifi.end_burst();
+                burst = false;
+            }
+            // Nothing to send or offline: sleep until a frame is closed or the link comes up
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (deadline > now)
+        {
+            // Wait for acknowledgements until the next retransmission is due
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(uplink->sock_, &fds);
+            int64_t wait_us = deadline - now;
+            struct timeval tv = {static_cast<time_t>(wait_us / 1000000), static_cast<suseconds_t>(wait_us % 1000000)};
+            if (select(uplink->sock_ + 1, &fds, nullptr, nullptr, &tv) > 0)
+            {
+                uplink->receive_acks();
+            }
+            continue;
+        }
+
+        // Frames closed meanwhile are picked up by send_due() as well
+        ulTaskNotifyTake(pdTRUE, 0);
+        if (!uplink->resolve())
+        {
+            vTaskDelay(pdMS_TO_TICKS(CONFIG_HV_UPLINK_RETRY_MS));
+            continue;
+        }
+        if (!burst)
+        {
+            // Power save off until every frame is acknowledged, acks arrive without beacon delay
+            wifi.begin_burst();
+            burst = true;
+        }
+        uplink->send_due(now);
+        uplink->receive_acks();
+    }
+}
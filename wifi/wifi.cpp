@@ -1,10 +1,13 @@
 #include "wifi.hpp"
 #include "esp_wifi.h"
 #include "esp_netif.h"
+#include "esp_mac.h"
+#include "esp_random.h"
 #include "esp_log.h"
-#include "esp_sntp.h"
 #include "nvs_flash.h"
 #include "nvs.hpp"
+#include "nvs_async.hpp"
+#include "nvs_schema.hpp"
 #include <esp_task_wdt.h>
 
 static const char *TAG = "hv-wifi";
@@ -12,48 +15,383 @@ static const char *TAG = "hv-wifi";
 #define WIFI_CONNECTED_BIT BIT0
 #define WIFI_FAIL_BIT BIT1
 
-void Wifi::wifi_event_handler(void *arg, esp_event_base_t event_base,
-                              int32_t event_id, void *event_data)
+// Credentials in the "config" namespace, written by the provisioning component.
+// Lengths match wifi_sta_config_t (32 byte SSID, 64 byte passphrase).
+static constexpr NvsField wifi_config_fields[] = {
+    nvs_str("wifi_ssid", 32, "unset"),
+    nvs_str("wifi_password", 64),
+};
+enum WifiConfigKey : size_t
+{
+    WIFI_SSID,
+    WIFI_PASSWORD,
+};
+using WifiConfigSchema = NvsSchema<wifi_config_fields>;
+
+// Cache of the last association, see WifiFastConnect
+static constexpr const char *FAST_CONNECT_NS = "wifi_cache";
+static constexpr const char *FAST_CONNECT_KEY = "fast_conn";
+static constexpr uint16_t FAST_CONNECT_VERSION = 1;
+
+void Wifi::load_fast_connect()
+{
+    fast_cache_ = {};
+#if CONFIG_HV_WIFI_FAST_RECONNECT
+    Nvs nvs;
+    WifiFastConnect cached;
+    if (nvs.open_namespace(FAST_CONNECT_NS) != ESP_OK ||
+        nvs.read_record(FAST_CONNECT_KEY, cached, FAST_CONNECT_VERSION) != ESP_OK)
+    {
+        return;
+    }
+    // Only usable while the cached network is still configured
+    for (size_t i = 0; i < networks_.size(); i++)
+    {
+        if (strcmp(networks_[i].net.ssid, cached.ssid) == 0)
+        {
+            fast_cache_ = cached;
+            current_net_ = i;
+            return;
+        }
+    }
+#endif
+}
+
+void Wifi::apply_fast_connect(wifi_config_t &wifi_config)
+{
+    fast_attempt_ = false;
+    static_ip_ = false;
+    if (fast_cache_.channel == 0)
+    {
+        return;
+    }
+
+    // Probe only the cached channel and associate with the cached AP
+    wifi_config.sta.bssid_set = true;
+    memcpy(wifi_config.sta.bssid, fast_cache_.bssid, sizeof(wifi_config.sta.bssid));
+    wifi_config.sta.channel = fast_cache_.channel;
+    wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+    fast_attempt_ = true;
+    ESP_LOGI(TAG, "Fast connect to " MACSTR " on channel %u", MAC2STR(fast_cache_.bssid), fast_cache_.channel);
+
+#if CONFIG_HV_WIFI_FAST_RECONNECT_STATIC_IP
+    if (fast_cache_.ip != 0 && esp_netif_dhcpc_stop(netif_) == ESP_OK)
+    {
+        esp_netif_ip_info_t ip_info = {};
+        ip_info.ip.addr = fast_cache_.ip;
+        ip_info.netmask.addr = fast_cache_.netmask;
+        ip_info.gw.addr = fast_cache_.gw;
+        esp_netif_set_ip_info(netif_, &ip_info);
+        if (fast_cache_.dns != 0)
+        {
+            esp_netif_dns_info_t dns = {};
+            dns.ip.type = ESP_IPADDR_TYPE_V4;
+            dns.ip.u_addr.ip4.addr = fast_cache_.dns;
+            esp_netif_set_dns_info(netif_, ESP_NETIF_DNS_MAIN, &dns);
+        }
+        static_ip_ = true;
+    }
+#endif
+}
+
+void Wifi::fall_back_to_scan()
+{
+    ESP_LOGI(TAG, "Cached AP not reachable, scanning all channels");
+    fast_attempt_ = false;
+    candidates_.clear();
+    cand_pos_ = 0;
+
+    wifi_config_t wifi_config;
+    esp_wifi_get_config(WIFI_IF_STA, &wifi_config);
+    wifi_config.sta.bssid_set = false;
+    wifi_config.sta.channel = 0;
+    wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+
+    // A different AP may be in a different subnet
+    if (static_ip_)
+    {
+        esp_netif_dhcpc_start(netif_);
+        static_ip_ = false;
+    }
+}
+
+void Wifi::save_fast_connect(const esp_netif_ip_info_t &ip_info)
+{
+#if CONFIG_HV_WIFI_FAST_RECONNECT
+    WifiFastConnect current = {};
+    strncpy(current.ssid, wifi_ssid.c_str(), sizeof(current.ssid) - 1);
+    memcpy(current.bssid, ap_bssid_, sizeof(current.bssid));
+    current.channel = ap_channel_;
+    current.ip = ip_info.ip.addr;
+    current.netmask = ip_info.netmask.addr;
+    current.gw = ip_info.gw.addr;
+    esp_netif_dns_info_t dns = {};
+    if (esp_netif_get_dns_info(netif_, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK && dns.ip.type == ESP_IPADDR_TYPE_V4)
+    {
+        current.dns = dns.ip.u_addr.ip4.addr;
+    }
+
+    // Only write flash when the AP or the lease changed
+    if (memcmp(&current, &fast_cache_, sizeof(current)) == 0)
+    {
+        return;
+    }
+    // Runs on the event task with mutex_ held, the flash write is left to the writer task
+    esp_err_t err = NvsAsyncWriter::getInstance().write_record(FAST_CONNECT_NS, FAST_CONNECT_KEY, current,
+                                                               FAST_CONNECT_VERSION);
+    if (err == ESP_OK)
+    {
+        fast_cache_ = current;
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Failed to cache AP: %s", esp_err_to_name(err));
+    }
+#else
+    (void)ip_info;
+#endif
+}
+
+esp_err_t Wifi::forget_fast_connect()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    fast_cache_ = {};
+    // A record still queued by save_fast_connect() would bring the key back after the erase
+    NvsAsyncWriter::getInstance().flush();
+    Nvs nvs;
+    esp_err_t err = nvs.open_namespace(FAST_CONNECT_NS);
+    if (err == ESP_OK)
+    {
+        err = nvs.erase_key(FAST_CONNECT_KEY);
+    }
+    return err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+}
+
+const char *wifi_state_name(WifiState state)
+{
+    switch (state)
+    {
+    case WifiState::IDLE:
+        return "idle";
+    case WifiState::CONNECTING:
+        return "connecting";
+    case WifiState::CONNECTED:
+        return "connected";
+    case WifiState::BACKOFF:
+        return "backoff";
+    }
+    return "?";
+}
+
+int Wifi::add_observer(WifiObserver observer)
+{
+    std::lock_guard<std::mutex> lock(observer_mutex_);
+    int id = next_observer_id_++;
+    observers_.emplace_back(id, std::move(observer));
+    return id;
+}
+
+void Wifi::remove_observer(int id)
+{
+    std::lock_guard<std::mutex> lock(observer_mutex_);
+    for (auto it = observers_.begin(); it != observers_.end(); ++it)
+    {
+        if (it->first == id)
+        {
+            observers_.erase(it);
+            return;
+        }
+    }
+}
+
+void Wifi::notify(WifiState from, WifiState to)
+{
+    ESP_LOGI(TAG, "%s -> %s", wifi_state_name(from), wifi_state_name(to));
+    std::vector<std::pair<int, WifiObserver>> observers;
+    {
+        std::lock_guard<std::mutex> lock(observer_mutex_);
+        observers = observers_;
+    }
+    for (auto &observer : observers)
+    {
+        observer.second(from, to);
+    }
+}
+
+WifiState Wifi::schedule_retry(uint8_t reason)
+{
+    s_retry_num_++;
+    if (s_retry_num_ >= CONFIG_HV_WIFI_MAX_RETRY)
+    {
+        // Ends wait_connected(), retrying continues
+        xEventGroupSetBits(s_wifi_event_group_, WIFI_FAIL_BIT);
+    }
+    uint32_t delay_ms = backoff_delay_ms(s_retry_num_);
+    ESP_LOGI(TAG, "disconnected (reason %d), attempt %d, retry in %lu ms", reason, s_retry_num_,
+             (unsigned long)delay_ms);
+    esp_timer_stop(backoff_timer_);
+    esp_timer_start_once(backoff_timer_, static_cast<uint64_t>(delay_ms) * 1000);
+    return WifiState::BACKOFF;
+}
+
+uint32_t Wifi::backoff_delay_ms(int attempt) const
+{
+    // Exponential backoff, the actual delay is drawn from [delay / 2, delay]
+    int shift = attempt > 1 ? attempt - 1 : 0;
+    uint64_t delay = static_cast<uint64_t>(CONFIG_HV_WIFI_BACKOFF_MIN_MS) << (shift < 16 ? shift : 16);
+    if (delay > CONFIG_HV_WIFI_BACKOFF_MAX_MS)
+    {
+        delay = CONFIG_HV_WIFI_BACKOFF_MAX_MS;
+    }
+    uint32_t half = static_cast<uint32_t>(delay / 2);
+    return half + esp_random() % (static_cast<uint32_t>(delay) - half + 1);
+}
+
+void Wifi::backoff_timer_cb(void *arg)
 {
     auto &wifi = Wifi::getInstance();
-    std::lock_guard<std::mutex> lock_wifi(wifi.getMutex());
-    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
+    WifiState from;
     {
-        esp_wifi_connect();
+        std::lock_guard<std::mutex> lock_wifi(wifi.getMutex());
+        from = wifi.state_.load();
+        if (from != WifiState::BACKOFF)
+        {
+            return;
+        }
+        wifi.state_.store(WifiState::CONNECTING);
+        // The failure of the previous attempt is over, wait_connected() now waits for this one
+        xEventGroupClearBits(wifi.s_wifi_event_group_, WIFI_FAIL_BIT);
+        wifi.next_attempt();
     }
-    else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
+    wifi.notify(from, WifiState::CONNECTING);
+}
+
+void Wifi::wifi_event_handler(void *arg, esp_event_base_t event_base,
+                              int32_t event_id, void *event_data)
+{
+    auto &wifi = Wifi::getInstance();
+    WifiState from;
+    WifiState to;
     {
-        if (wifi.s_retry_num_ < CONFIG_HV_WIFI_MAX_RETRY)
+        std::lock_guard<std::mutex> lock_wifi(wifi.getMutex());
+        from = to = wifi.state_.load();
+        if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START)
         {
-            esp_wifi_connect();
-            wifi.s_retry_num_++;
-            ESP_LOGI(TAG, "retry to connect to the AP");
+            if (from == WifiState::CONNECTING)
+            {
+                wifi.next_attempt();
+            }
         }
-        else
+        else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_SCAN_DONE)
+        {
+            if (wifi.scanning_)
+            {
+                wifi.scanning_ = false;
+                wifi.rank_candidates();
+                if (from == WifiState::IDLE)
+                {
+                    // stop() was called during the scan
+                }
+                else if (wifi.candidates_.empty())
+                {
+                    to = wifi.schedule_retry(0);
+                }
+                else
+                {
+                    wifi.connect_candidate();
+                }
+            }
+        }
+        else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED)
         {
-            xEventGroupSetBits(wifi.s_wifi_event_group_, WIFI_FAIL_BIT);
+            auto *event = static_cast<wifi_event_sta_connected_t *>(event_data);
+            memcpy(wifi.ap_bssid_, event->bssid, sizeof(wifi.ap_bssid_));
+            wifi.ap_channel_ = event->channel;
+            wifi.stats_associated();
         }
-        ESP_LOGI(TAG, "connect to the AP fail");
-        wifi.is_connected = false;
+        else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED)
+        {
+            auto *event = static_cast<wifi_event_sta_disconnected_t *>(event_data);
+            xEventGroupClearBits(wifi.s_wifi_event_group_, WIFI_CONNECTED_BIT);
+            wifi.stats_disconnected(event->reason, event->rssi);
+            if (from == WifiState::IDLE)
+            {
+                // stop() was called
+            }
+            else if (wifi.fast_attempt_)
+            {
+                // Failed targeted connect does not count as a retry
+                wifi.fall_back_to_scan();
+                wifi.next_attempt();
+                to = WifiState::CONNECTING;
+            }
+            else if (wifi.cand_pos_ < wifi.candidates_.size())
+            {
+                // Try each ranked candidate a few times before the cycle counts as failed
+                if (++wifi.cand_attempts_ < CONFIG_HV_WIFI_ATTEMPTS_PER_AP)
+                {
+                    wifi.connect_attempt();
+                    to = WifiState::CONNECTING;
+                }
+                else
+                {
+                    wifi.record_result(false);
+                    wifi.cand_pos_++;
+                    wifi.cand_attempts_ = 0;
+                    if (wifi.cand_pos_ < wifi.candidates_.size())
+                    {
+                        wifi.connect_candidate();
+                        to = WifiState::CONNECTING;
+                    }
+                    else
+                    {
+                        wifi.save_history();
+                        to = wifi.schedule_retry(event->reason);
+                    }
+                }
+            }
+            else
+            {
+                to = wifi.schedule_retry(event->reason);
+            }
+        }
+        else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+        {
+            ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+            ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
+            wifi.stats_got_ip();
+            wifi.record_result(true);
+            wifi.save_history();
+            wifi.cand_attempts_ = 0;
+            wifi.s_retry_num_ = 0;
+            wifi.fast_attempt_ = false;
+            wifi.save_fast_connect(event->ip_info);
+            xEventGroupClearBits(wifi.s_wifi_event_group_, WIFI_FAIL_BIT);
+            xEventGroupSetBits(wifi.s_wifi_event_group_, WIFI_CONNECTED_BIT);
+            if (from != WifiState::IDLE)
+            {
+                to = WifiState::CONNECTED;
+            }
+        }
+        wifi.state_.store(to);
     }
-    else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP)
+    if (to != from)
     {
-        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
-        ESP_LOGI(TAG, "got ip:" IPSTR, IP2STR(&event->ip_info.ip));
-        wifi.s_retry_num_ = 0;
-        xEventGroupSetBits(wifi.s_wifi_event_group_, WIFI_CONNECTED_BIT);
-        wifi.is_connected = true;
+        wifi.notify(from, to);
     }
 }
 
-esp_err_t Wifi::wifi_connect(void)
+esp_err_t Wifi::init_driver()
 {
-    esp_err_t ret = ESP_OK;
-    Wifi::is_connected = false;
+    if (initialized_)
+    {
+        return ESP_OK;
+    }
 
     // Initialize event loop only once
     // Calling this multiple times will cause ESP_ERR_INVALID_STATE
-    ret = esp_event_loop_create_default();
+    esp_err_t ret = esp_event_loop_create_default();
     if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE)
     {
         ESP_LOGE(TAG, "Failed to create event loop: %s", esp_err_to_name(ret));
@@ -63,13 +401,24 @@ esp_err_t Wifi::wifi_connect(void)
     // Create event group
     s_wifi_event_group_ = xEventGroupCreate();
 
+    esp_timer_create_args_t timer_args = {};
+    timer_args.callback = &backoff_timer_cb;
+    timer_args.name = "wifi_backoff";
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &backoff_timer_));
+    timer_args.callback = &rssi_timer_cb;
+    timer_args.name = "wifi_rssi";
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &rssi_timer_));
+    timer_args.callback = &burst_timer_cb;
+    timer_args.name = "wifi_burst";
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &burst_timer_));
+
     // Initialize WiFi
     ESP_ERROR_CHECK(esp_netif_init());
-    esp_netif_t *netif = esp_netif_create_default_wifi_sta();
+    netif_ = esp_netif_create_default_wifi_sta();
 
     if (!hostname_.empty())
     {
-        esp_err_t err = esp_netif_set_hostname(netif, hostname_.c_str());
+        esp_err_t err = esp_netif_set_hostname(netif_, hostname_.c_str());
         if (err == ESP_OK)
         {
             ESP_LOGI(TAG, "Set hostname to: %s", hostname_.c_str());
@@ -95,28 +444,118 @@ esp_err_t Wifi::wifi_connect(void)
                                                         &wifi_event_handler,
                                                         NULL,
                                                         &instance_got_ip));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    return ESP_OK;
+}
 
-    wifi_config_t wifi_config = {};
-    wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
-    wifi_config.sta.pmf_cfg.capable = true;
-    wifi_config.sta.pmf_cfg.required = false;
-
-    // Copy SSID and password
-    Nvs nvs_creds;
-    ret = nvs_creds.open_namespace("config");
-    if (ret == ESP_OK)
+esp_err_t Wifi::start(void)
+{
+    WifiState from;
     {
-        nvs_creds.read("wifi_ssid", wifi_ssid);
-        nvs_creds.read("wifi_password", wifi_password);
+        std::lock_guard<std::mutex> lock(mutex_);
+        from = state_.load();
+        if (from != WifiState::IDLE)
+        {
+            return ESP_OK;
+        }
+
+        bool driver_started = initialized_;
+        esp_err_t ret = init_driver();
+        if (ret != ESP_OK)
+        {
+            return ret;
+        }
+        initialized_ = true;
+
+        // Stores the fast connect cache and the network history, see save_fast_connect()
+        ret = NvsAsyncWriter::getInstance().start();
+        if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE)
+        {
+            ESP_LOGW(TAG, "NVS writer not started, connection cache not stored: %s", esp_err_to_name(ret));
+        }
+
+        // Legacy single network, merged into the credential list by load_networks()
+        WifiConfigSchema creds;
+        Nvs nvs_creds;
+        if (nvs_creds.open_namespace("config") == ESP_OK)
+        {
+            creds.load(nvs_creds);
+        }
+        wifi_ssid = creds.get<WIFI_SSID>();
+        wifi_password = creds.get<WIFI_PASSWORD>();
+
+        load_networks();
+        candidates_.clear();
+        cand_pos_ = 0;
+        cand_attempts_ = 0;
+        scanning_ = false;
+        current_net_ = 0;
+
+        // With several networks the first attempt waits for a scan unless the cached AP is tried
+        load_fast_connect();
+        wifi_config_t wifi_config;
+        sta_config(wifi_config, networks_[current_net_].net);
+        apply_fast_connect(wifi_config);
+        wifi_ssid = networks_[current_net_].net.ssid;
+
+        s_retry_num_ = 0;
+        cycle_start_us_ = esp_timer_get_time();
+        start_power_locked(cycle_start_us_);
+        xEventGroupClearBits(s_wifi_event_group_, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+        state_.store(WifiState::CONNECTING);
+
+        ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+        if (driver_started)
+        {
+            next_attempt();
+        }
+        else
+        {
+            // WIFI_EVENT_STA_START starts the first attempt
+            ESP_ERROR_CHECK(esp_wifi_start());
+        }
     }
-    strncpy((char *)wifi_config.sta.ssid, wifi_ssid.c_str(), sizeof(wifi_config.sta.ssid) - 1);
-    strncpy((char *)wifi_config.sta.password, wifi_password.c_str(), sizeof(wifi_config.sta.password) - 1);
+    notify(from, WifiState::CONNECTING);
+    return ESP_OK;
+}
 
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
-    ESP_ERROR_CHECK(esp_wifi_start());
+esp_err_t Wifi::stop(void)
+{
+    WifiState from;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        from = state_.load();
+        if (from == WifiState::IDLE)
+        {
+            return ESP_OK;
+        }
+        state_.store(WifiState::IDLE);
+        esp_timer_stop(backoff_timer_);
+        stop_power_locked(esp_timer_get_time());
+        if (scanning_)
+        {
+            esp_wifi_scan_stop();
+            scanning_ = false;
+        }
+        esp_wifi_disconnect();
+        if (static_ip_)
+        {
+            esp_netif_dhcpc_start(netif_);
+            static_ip_ = false;
+        }
+        xEventGroupClearBits(s_wifi_event_group_, WIFI_CONNECTED_BIT);
+        xEventGroupSetBits(s_wifi_event_group_, WIFI_FAIL_BIT);
+    }
+    notify(from, WifiState::IDLE);
+    return ESP_OK;
+}
 
-    ESP_LOGI(TAG, "wifi_connect finished.");
+esp_err_t Wifi::wait_connected(TickType_t timeout)
+{
+    if (!s_wifi_event_group_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
 
     /* Waiting until either the connection is established (WIFI_CONNECTED_BIT) or connection failed for the maximum
      * number of re-tries (WIFI_FAIL_BIT). The bits are set by event_handler() (see above) */
@@ -124,7 +563,7 @@ esp_err_t Wifi::wifi_connect(void)
                                            WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
                                            pdFALSE,
                                            pdFALSE,
-                                           portMAX_DELAY);
+                                           timeout);
 
     /* xEventGroupWaitBits() returns the bits before the call returned, hence we can test which event actually
      * happened. */
@@ -140,39 +579,16 @@ esp_err_t Wifi::wifi_connect(void)
     }
     else
     {
-        ESP_LOGE(TAG, "UNEXPECTED EVENT");
         return ESP_ERR_TIMEOUT;
     }
 }
 
-esp_err_t Wifi::time_sync(void)
+esp_err_t Wifi::wifi_connect(void)
 {
-    setenv("TZ", CONFIG_HV_WIFI_TIMEZONE, 1);
-    tzset();
-
-    esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
-    esp_sntp_setservername(0, CONFIG_HV_WIFI_TIME_SERVER_0);
-    esp_sntp_setservername(1, CONFIG_HV_WIFI_TIME_SERVER_1);
-    esp_sntp_init();
-
-    // Wait for time to sync
-    time_t now = 0;
-    struct tm timeinfo = {};
-    int retry = 0;
-    const int retry_count = 10;
-
-    while (sntp_get_sync_status() == SNTP_SYNC_STATUS_RESET && ++retry < retry_count)
-    {
-        vTaskDelay(2000 / portTICK_PERIOD_MS);
-    }
-
-    time(&now);
-    localtime_r(&now, &timeinfo);
-
-    if (retry >= retry_count)
+    esp_err_t ret = start();
+    if (ret != ESP_OK)
     {
-        return ESP_FAIL;
+        return ret;
     }
-
-    return ESP_OK;
+    return wait_connected();
 }
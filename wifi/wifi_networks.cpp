@@ -0,0 +1,387 @@
+#include "wifi.hpp"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "nvs.hpp"
+#include "nvs_async.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static const char *TAG = "hv-wifi";
+
+// Credential list: one record per slot ("net0" ...) and one history record for all slots
+static constexpr const char *NETWORKS_NS = "wifi_nets";
+static constexpr const char *HISTORY_KEY = "hist";
+static constexpr uint16_t NETWORKS_VERSION = 1;
+static constexpr uint8_t NO_SLOT = 0xFF;
+// Counts are halved above this sum, so old results fade out
+static constexpr uint32_t HISTORY_AGE_LIMIT = 64;
+
+static void slot_key(size_t slot, char (&key)[8])
+{
+    snprintf(key, sizeof(key), "net%u", static_cast<unsigned>(slot));
+}
+
+void Wifi::sta_config(wifi_config_t &wifi_config, const WifiNetwork &net) const
+{
+    wifi_config = {};
+    wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+    wifi_config.sta.pmf_cfg.capable = true;
+    wifi_config.sta.pmf_cfg.required = false;
+    // Both fields may use their full length without a terminating NUL
+    memcpy(wifi_config.sta.ssid, net.ssid, strnlen(net.ssid, sizeof(wifi_config.sta.ssid)));
+    memcpy(wifi_config.sta.password, net.password, strnlen(net.password, sizeof(wifi_config.sta.password)));
+    // Only used with WIFI_PS_MAX_MODEM; 0 keeps the driver default of 3 beacons
+    if (power_profile_ == WifiPowerProfile::AGGRESSIVE)
+    {
+        wifi_config.sta.listen_interval = CONFIG_HV_WIFI_LISTEN_INTERVAL;
+    }
+}
+
+void Wifi::load_networks()
+{
+    networks_.clear();
+    history_ = {};
+    history_.last_ok = NO_SLOT;
+    history_dirty_ = false;
+
+    Nvs nvs;
+    if (nvs.open_namespace(NETWORKS_NS) == ESP_OK)
+    {
+        for (size_t slot = 0; slot < WIFI_MAX_NETWORKS; slot++)
+        {
+            char key[8];
+            slot_key(slot, key);
+            NetEntry entry = {};
+            if (nvs.read_record(key, entry.net, NETWORKS_VERSION) == ESP_OK && entry.net.ssid[0] != '\0')
+            {
+                entry.net.ssid[sizeof(entry.net.ssid) - 1] = '\0';
+                entry.net.password[sizeof(entry.net.password) - 1] = '\0';
+                entry.slot = slot;
+                networks_.push_back(entry);
+            }
+        }
+        if (nvs.read_record(HISTORY_KEY, history_, NETWORKS_VERSION) != ESP_OK)
+        {
+            history_ = {};
+            history_.last_ok = NO_SLOT;
+        }
+    }
+
+    // The provisioned pair from the "config" namespace is always part of the list
+    bool listed = std::any_of(networks_.begin(), networks_.end(),
+                              [&](const NetEntry &e) { return wifi_ssid == e.net.ssid; });
+    if (!listed && (wifi_ssid != "unset" || networks_.empty()))
+    {
+        NetEntry entry = {};
+        strncpy(entry.net.ssid, wifi_ssid.c_str(), sizeof(entry.net.ssid) - 1);
+        strncpy(entry.net.password, wifi_password.c_str(), sizeof(entry.net.password) - 1);
+        entry.slot = WIFI_MAX_NETWORKS;
+        networks_.push_back(entry);
+    }
+}
+
+void Wifi::next_attempt()
+{
+    if (fast_attempt_)
+    {
+        connect_attempt();
+    }
+    else if (networks_.size() == 1)
+    {
+        if (s_retry_num_ > 0)
+        {
+            // Reconnect after a failed cycle: let the driver scan all channels again
+            wifi_config_t wifi_config;
+            sta_config(wifi_config, networks_[0].net);
+            esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+        }
+        connect_attempt();
+    }
+    else if (cand_pos_ >= candidates_.size())
+    {
+        start_scan();
+    }
+    else
+    {
+        connect_candidate();
+    }
+}
+
+void Wifi::start_scan()
+{
+    wifi_scan_config_t scan_config = {};
+    scanning_ = true;
+    esp_err_t err = esp_wifi_scan_start(&scan_config, false);
+    if (err == ESP_OK)
+    {
+        return;
+    }
+
+    // Without a scan the driver searches for the network with the highest priority itself
+    ESP_LOGW(TAG, "Scan failed: %s", esp_err_to_name(err));
+    scanning_ = false;
+    candidates_.clear();
+    current_net_ = 0;
+    for (size_t i = 1; i < networks_.size(); i++)
+    {
+        if (networks_[i].net.priority > networks_[current_net_].net.priority)
+            current_net_ = i;
+    }
+    wifi_config_t wifi_config;
+    sta_config(wifi_config, networks_[current_net_].net);
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    wifi_ssid = networks_[current_net_].net.ssid;
+    connect_attempt();
+}
+
+void Wifi::rank_candidates()
+{
+    candidates_.clear();
+    cand_pos_ = 0;
+    cand_attempts_ = 0;
+
+    uint16_t count = CONFIG_HV_WIFI_SCAN_MAX_APS;
+    std::vector<wifi_ap_record_t> aps(count);
+    if (esp_wifi_scan_get_ap_records(&count, aps.data()) != ESP_OK)
+    {
+        count = 0;
+    }
+
+    for (size_t i = 0; i < networks_.size(); i++)
+    {
+        // Strongest AP of each stored network
+        const wifi_ap_record_t *best = nullptr;
+        for (size_t a = 0; a < count; a++)
+        {
+            if (strncmp(reinterpret_cast<const char *>(aps[a].ssid), networks_[i].net.ssid, sizeof(aps[a].ssid)) == 0 &&
+                (!best || aps[a].rssi > best->rssi))
+            {
+                best = &aps[a];
+            }
+        }
+        if (!best)
+        {
+            continue;
+        }
+
+        // Priority dominates, then signal; success history and the last used network break ties
+        const NetHistory &h = history_.nets[networks_[i].slot];
+        Candidate c = {};
+        c.net = i;
+        memcpy(c.bssid, best->bssid, sizeof(c.bssid));
+        c.channel = best->primary;
+        c.rssi = best->rssi;
+        c.score = networks_[i].net.priority * 100 + best->rssi + 40 * h.successes / (h.successes + h.failures + 1);
+        if (networks_[i].slot == history_.last_ok)
+        {
+            c.score += 10;
+        }
+        candidates_.push_back(c);
+    }
+
+    std::stable_sort(candidates_.begin(), candidates_.end(),
+                     [](const Candidate &a, const Candidate &b) { return a.score > b.score; });
+    for (const Candidate &c : candidates_)
+    {
+        ESP_LOGI(TAG, "candidate %s rssi %d score %d", networks_[c.net].net.ssid, c.rssi, c.score);
+    }
+    if (candidates_.empty())
+    {
+        ESP_LOGI(TAG, "No stored network in range (%u APs seen)", count);
+    }
+}
+
+void Wifi::connect_candidate()
+{
+    const Candidate &c = candidates_[cand_pos_];
+    current_net_ = c.net;
+
+    // Connect to the AP found by the scan, the driver does not scan again
+    wifi_config_t wifi_config;
+    sta_config(wifi_config, networks_[c.net].net);
+    wifi_config.sta.bssid_set = true;
+    memcpy(wifi_config.sta.bssid, c.bssid, sizeof(wifi_config.sta.bssid));
+    wifi_config.sta.channel = c.channel;
+    wifi_config.sta.scan_method = WIFI_FAST_SCAN;
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+
+    wifi_ssid = networks_[c.net].net.ssid;
+    ESP_LOGI(TAG, "Connecting to %s (" MACSTR ", channel %u)", wifi_ssid.c_str(), MAC2STR(c.bssid), c.channel);
+    connect_attempt();
+}
+
+void Wifi::record_result(bool success)
+{
+    if (current_net_ >= networks_.size())
+    {
+        return;
+    }
+    size_t slot = networks_[current_net_].slot;
+    NetHistory &h = history_.nets[slot];
+    if (success)
+    {
+        h.successes++;
+        // Repeated successes on the same network are not worth a flash write of their own
+        if (history_.last_ok != slot)
+        {
+            history_.last_ok = static_cast<uint8_t>(slot);
+            history_dirty_ = true;
+        }
+    }
+    else
+    {
+        h.failures++;
+        history_dirty_ = true;
+    }
+    if (h.successes + h.failures > HISTORY_AGE_LIMIT)
+    {
+        h.successes /= 2;
+        h.failures /= 2;
+    }
+}
+
+void Wifi::save_history()
+{
+    if (!history_dirty_)
+    {
+        return;
+    }
+    // Called from the event handler with mutex_ held, the writer task does the flash write
+    esp_err_t err = NvsAsyncWriter::getInstance().write_record(NETWORKS_NS, HISTORY_KEY, history_, NETWORKS_VERSION);
+    if (err != ESP_OK)
+    {
+        // Stays dirty, the next result tries again
+        ESP_LOGW(TAG, "Failed to store network history: %s", esp_err_to_name(err));
+        return;
+    }
+    history_dirty_ = false;
+}
+
+esp_err_t Wifi::add_network(std::string_view ssid, std::string_view password, int8_t priority)
+{
+    if (ssid.empty() || ssid.size() >= sizeof(WifiNetwork::ssid) || password.size() >= sizeof(WifiNetwork::password))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Nvs nvs;
+    esp_err_t err = nvs.open_namespace(NETWORKS_NS);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    // Same SSID first, otherwise the first free slot
+    size_t slot = WIFI_MAX_NETWORKS;
+    bool replace = false;
+    for (size_t s = 0; s < WIFI_MAX_NETWORKS && !replace; s++)
+    {
+        char key[8];
+        slot_key(s, key);
+        WifiNetwork stored;
+        if (nvs.read_record(key, stored, NETWORKS_VERSION) == ESP_OK && stored.ssid[0] != '\0')
+        {
+            if (ssid == std::string_view(stored.ssid, strnlen(stored.ssid, sizeof(stored.ssid))))
+            {
+                slot = s;
+                replace = true;
+            }
+        }
+        else if (slot == WIFI_MAX_NETWORKS)
+        {
+            slot = s;
+        }
+    }
+    if (slot == WIFI_MAX_NETWORKS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    WifiNetwork net = {};
+    memcpy(net.ssid, ssid.data(), ssid.size());
+    memcpy(net.password, password.data(), password.size());
+    net.priority = priority;
+
+    char key[8];
+    slot_key(slot, key);
+    // The history is read back below, a copy still queued by save_history() would overwrite it
+    NvsAsyncWriter::getInstance().flush();
+    NvsTransaction tx(nvs);
+    err = nvs.write_record(key, net, NETWORKS_VERSION);
+    if (err == ESP_OK && !replace)
+    {
+        // A new network starts without the history of the slot's previous occupant
+        HistoryRecord history;
+        if (nvs.read_record(HISTORY_KEY, history, NETWORKS_VERSION) == ESP_OK)
+        {
+            history.nets[slot] = {};
+            if (history.last_ok == slot)
+                history.last_ok = NO_SLOT;
+            err = nvs.write_record(HISTORY_KEY, history, NETWORKS_VERSION);
+        }
+    }
+    if (err != ESP_OK)
+    {
+        tx.rollback();
+        return err;
+    }
+    return tx.commit();
+}
+
+esp_err_t Wifi::remove_network(std::string_view ssid)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Nvs nvs;
+    esp_err_t err = nvs.open_namespace(NETWORKS_NS);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    for (size_t s = 0; s < WIFI_MAX_NETWORKS; s++)
+    {
+        char key[8];
+        slot_key(s, key);
+        WifiNetwork stored;
+        if (nvs.read_record(key, stored, NETWORKS_VERSION) == ESP_OK &&
+            ssid == std::string_view(stored.ssid, strnlen(stored.ssid, sizeof(stored.ssid))))
+        {
+            return nvs.erase_key(key);
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+std::vector<WifiNetworkInfo> Wifi::get_networks() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<WifiNetworkInfo> infos;
+    Nvs nvs;
+    HistoryRecord history = {};
+    if (nvs.open_namespace(NETWORKS_NS) == ESP_OK)
+    {
+        nvs.read_record(HISTORY_KEY, history, NETWORKS_VERSION);
+        for (size_t s = 0; s < WIFI_MAX_NETWORKS; s++)
+        {
+            char key[8];
+            slot_key(s, key);
+            WifiNetwork stored;
+            if (nvs.read_record(key, stored, NETWORKS_VERSION) == ESP_OK && stored.ssid[0] != '\0')
+            {
+                infos.push_back({std::string(stored.ssid, strnlen(stored.ssid, sizeof(stored.ssid))), stored.priority,
+                                 history.nets[s].successes, history.nets[s].failures, false});
+            }
+        }
+    }
+    // The legacy pair as merged by the last start()
+    for (const NetEntry &e : networks_)
+    {
+        if (e.slot == WIFI_MAX_NETWORKS)
+        {
+            infos.push_back({e.net.ssid, e.net.priority, history.nets[e.slot].successes,
+                             history.nets[e.slot].failures, true});
+        }
+    }
+    return infos;
+}
@@ -0,0 +1,246 @@
+#include "wifi.hpp"
+#include "esp_log.h"
+
+static const char *TAG = "hv-wifi";
+
+const char *wifi_power_profile_name(WifiPowerProfile profile)
+{
+    switch (profile)
+    {
+    case WifiPowerProfile::PERFORMANCE:
+        return "performance";
+    case WifiPowerProfile::BALANCED:
+        return "balanced";
+    case WifiPowerProfile::AGGRESSIVE:
+        return "aggressive";
+    }
+    return "?";
+}
+
+static wifi_ps_type_t ps_type(WifiPowerProfile profile)
+{
+    switch (profile)
+    {
+    case WifiPowerProfile::PERFORMANCE:
+        return WIFI_PS_NONE;
+    case WifiPowerProfile::AGGRESSIVE:
+        return WIFI_PS_MAX_MODEM;
+    default:
+        return WIFI_PS_MIN_MODEM;
+    }
+}
+
+void Wifi::account_power_locked(int64_t now_us)
+{
+    if (power_since_us_ != 0)
+    {
+        power_stats_[static_cast<size_t>(power_active_)].active_ms += (now_us - power_since_us_) / 1000;
+        power_since_us_ = now_us;
+    }
+}
+
+bool Wifi::apply_power_locked(WifiPowerProfile profile, WifiPowerProfile &from)
+{
+    from = power_active_;
+    if (profile == from)
+    {
+        return false;
+    }
+    if (initialized_)
+    {
+        esp_err_t err = esp_wifi_set_ps(ps_type(profile));
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Failed to set power save mode: %s", esp_err_to_name(err));
+            return false;
+        }
+    }
+    account_power_locked(esp_timer_get_time());
+    power_active_ = profile;
+    power_stats_[static_cast<size_t>(profile)].entered++;
+    return true;
+}
+
+void Wifi::start_power_locked(int64_t now_us)
+{
+    esp_err_t err = esp_wifi_set_ps(ps_type(power_active_));
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to set power save mode: %s", esp_err_to_name(err));
+    }
+    power_since_us_ = now_us;
+}
+
+void Wifi::stop_power_locked(int64_t now_us)
+{
+    account_power_locked(now_us);
+    power_since_us_ = 0;
+}
+
+void Wifi::notify_power(WifiPowerProfile from, WifiPowerProfile to)
+{
+    ESP_LOGD(TAG, "power %s -> %s", wifi_power_profile_name(from), wifi_power_profile_name(to));
+    WifiPowerHook hook;
+    {
+        std::lock_guard<std::mutex> lock(observer_mutex_);
+        hook = power_hook_;
+    }
+    if (hook)
+    {
+        hook(from, to);
+    }
+}
+
+esp_err_t Wifi::set_power_profile(WifiPowerProfile profile)
+{
+    if (static_cast<size_t>(profile) >= WIFI_POWER_PROFILE_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    WifiPowerProfile from;
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        power_profile_ = profile;
+        if (burst_count_ == 0 && !burst_hold_)
+        {
+            changed = apply_power_locked(profile, from);
+        }
+    }
+    ESP_LOGI(TAG, "Power profile %s", wifi_power_profile_name(profile));
+    if (changed)
+    {
+        notify_power(from, profile);
+    }
+    return ESP_OK;
+}
+
+WifiPowerProfile Wifi::get_power_profile() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return power_profile_;
+}
+
+WifiPowerProfile Wifi::get_active_power_profile() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return power_active_;
+}
+
+void Wifi::begin_burst()
+{
+    WifiPowerProfile from;
+    bool changed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        burst_count_++;
+        if (burst_hold_)
+        {
+            esp_timer_stop(burst_timer_);
+            burst_hold_ = false;
+        }
+        changed = apply_power_locked(WifiPowerProfile::PERFORMANCE, from);
+    }
+    if (changed)
+    {
+        notify_power(from, WifiPowerProfile::PERFORMANCE);
+    }
+}
+
+void Wifi::end_burst()
+{
+    WifiPowerProfile from;
+    WifiPowerProfile to;
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (burst_count_ == 0 || --burst_count_ > 0)
+        {
+            return;
+        }
+        // Stay awake a little longer, so closely spaced bursts do not toggle power save
+        if (CONFIG_HV_WIFI_BURST_HOLD_MS > 0 && burst_timer_)
+        {
+            burst_hold_ = true;
+            esp_timer_start_once(burst_timer_, static_cast<uint64_t>(CONFIG_HV_WIFI_BURST_HOLD_MS) * 1000);
+            return;
+        }
+        to = power_profile_;
+        changed = apply_power_locked(to, from);
+    }
+    if (changed)
+    {
+        notify_power(from, to);
+    }
+}
+
+void Wifi::burst_timer_cb(void *arg)
+{
+    auto &wifi = Wifi::getInstance();
+    WifiPowerProfile from;
+    WifiPowerProfile to;
+    bool changed = false;
+    {
+        std::lock_guard<std::mutex> lock(wifi.mutex_);
+        if (wifi.burst_count_ > 0 || !wifi.burst_hold_)
+        {
+            return;
+        }
+        wifi.burst_hold_ = false;
+        to = wifi.power_profile_;
+        changed = wifi.apply_power_locked(to, from);
+    }
+    if (changed)
+    {
+        wifi.notify_power(from, to);
+    }
+}
+
+void Wifi::record_transfer(size_t bytes, uint32_t latency_us)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    WifiPowerStats &stats = power_stats_[static_cast<size_t>(power_active_)];
+    stats.transfers++;
+    stats.bytes += bytes;
+    stats.latency_us_sum += latency_us;
+    if (latency_us > stats.latency_us_max)
+    {
+        stats.latency_us_max = latency_us;
+    }
+}
+
+void Wifi::set_power_hook(WifiPowerHook hook)
+{
+    std::lock_guard<std::mutex> lock(observer_mutex_);
+    power_hook_ = std::move(hook);
+}
+
+WifiPowerStats Wifi::get_power_stats(WifiPowerProfile profile) const
+{
+    if (static_cast<size_t>(profile) >= WIFI_POWER_PROFILE_COUNT)
+    {
+        return {};
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    WifiPowerStats stats = power_stats_[static_cast<size_t>(profile)];
+    if (profile == power_active_ && power_since_us_ != 0)
+    {
+        // Include the period still running
+        stats.active_ms += (esp_timer_get_time() - power_since_us_) / 1000;
+    }
+    return stats;
+}
+
+void Wifi::reset_power_stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &stats : power_stats_)
+    {
+        stats = {};
+    }
+    if (power_since_us_ != 0)
+    {
+        power_since_us_ = esp_timer_get_time();
+    }
+}
@@ -0,0 +1,183 @@
+#include "wifi.hpp"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "hv-wifi-stats";
+
+static uint32_t elapsed_ms(int64_t from_us, int64_t to_us)
+{
+    return from_us > 0 && to_us > from_us ? static_cast<uint32_t>((to_us - from_us) / 1000) : 0;
+}
+
+void Wifi::connect_attempt()
+{
+    attempt_start_us_ = esp_timer_get_time();
+    assoc_us_ = 0;
+    stats_.attempts++;
+    esp_wifi_connect();
+}
+
+void Wifi::stats_associated()
+{
+    assoc_us_ = esp_timer_get_time();
+    stats_.assoc_ms = elapsed_ms(attempt_start_us_, assoc_us_);
+}
+
+void Wifi::stats_got_ip()
+{
+    int64_t now = esp_timer_get_time();
+    connected_us_ = now;
+    stats_.connects++;
+    if (fast_attempt_)
+    {
+        stats_.fast_connects++;
+    }
+    stats_.dhcp_ms = elapsed_ms(assoc_us_, now);
+    stats_.connect_ms = elapsed_ms(cycle_start_us_, now);
+    stats_.connect_ms_sum += stats_.connect_ms;
+    if (stats_.connect_ms > stats_.connect_ms_max)
+    {
+        stats_.connect_ms_max = stats_.connect_ms;
+    }
+    ESP_LOGI(TAG, "connected in %lu ms (assoc %lu ms, dhcp %lu ms)", (unsigned long)stats_.connect_ms,
+             (unsigned long)stats_.assoc_ms, (unsigned long)stats_.dhcp_ms);
+
+    esp_timer_stop(rssi_timer_);
+    esp_timer_start_periodic(rssi_timer_, static_cast<uint64_t>(CONFIG_HV_WIFI_RSSI_SAMPLE_S) * 1000000);
+}
+
+void Wifi::stats_disconnected(uint8_t reason, int8_t rssi)
+{
+    int64_t now = esp_timer_get_time();
+    WifiDisconnect &entry = stats_.disconnects[disconnect_head_];
+    entry.time_us = now;
+    entry.reason = reason;
+    entry.rssi = rssi;
+    entry.connected_s = 0;
+    disconnect_head_ = (disconnect_head_ + 1) % WIFI_DISCONNECT_HISTORY_LEN;
+    if (stats_.disconnect_count < WIFI_DISCONNECT_HISTORY_LEN)
+    {
+        stats_.disconnect_count++;
+    }
+
+    if (connected_us_ == 0)
+    {
+        stats_.failed_attempts++;
+        return;
+    }
+
+    uint32_t uptime_s = static_cast<uint32_t>((now - connected_us_) / 1000000);
+    entry.connected_s = uptime_s;
+    stats_.links_lost++;
+    stats_.total_uptime_s += uptime_s;
+    if (uptime_s > stats_.longest_uptime_s)
+    {
+        stats_.longest_uptime_s = uptime_s;
+    }
+    connected_us_ = 0;
+    cycle_start_us_ = now;
+    esp_timer_stop(rssi_timer_);
+}
+
+void Wifi::rssi_timer_cb(void *arg)
+{
+    auto &wifi = Wifi::getInstance();
+    int rssi;
+    if (esp_wifi_sta_get_rssi(&rssi) != ESP_OK)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(wifi.getMutex());
+    wifi.stats_.rssi[wifi.rssi_head_] = static_cast<int8_t>(rssi);
+    wifi.rssi_head_ = (wifi.rssi_head_ + 1) % WIFI_RSSI_HISTORY_LEN;
+    if (wifi.stats_.rssi_count < WIFI_RSSI_HISTORY_LEN)
+    {
+        wifi.stats_.rssi_count++;
+    }
+}
+
+WifiStats Wifi::get_stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    WifiStats stats = stats_;
+
+    // Rotate the rings so the oldest entry comes first
+    size_t first = (disconnect_head_ + WIFI_DISCONNECT_HISTORY_LEN - stats_.disconnect_count) % WIFI_DISCONNECT_HISTORY_LEN;
+    for (size_t i = 0; i < stats_.disconnect_count; i++)
+    {
+        stats.disconnects[i] = stats_.disconnects[(first + i) % WIFI_DISCONNECT_HISTORY_LEN];
+    }
+    first = (rssi_head_ + WIFI_RSSI_HISTORY_LEN - stats_.rssi_count) % WIFI_RSSI_HISTORY_LEN;
+    for (size_t i = 0; i < stats_.rssi_count; i++)
+    {
+        stats.rssi[i] = stats_.rssi[(first + i) % WIFI_RSSI_HISTORY_LEN];
+    }
+
+    if (connected_us_ != 0)
+    {
+        stats.uptime_s = static_cast<uint32_t>((esp_timer_get_time() - connected_us_) / 1000000);
+        stats.total_uptime_s += stats.uptime_s;
+        if (stats.uptime_s > stats.longest_uptime_s)
+        {
+            stats.longest_uptime_s = stats.uptime_s;
+        }
+    }
+    return stats;
+}
+
+void Wifi::reset_stats()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_ = {};
+    disconnect_head_ = 0;
+    rssi_head_ = 0;
+    if (connected_us_ != 0)
+    {
+        // The current connection counts from now on
+        connected_us_ = esp_timer_get_time();
+    }
+}
+
+void Wifi::log_stats() const
+{
+    WifiStats stats = get_stats();
+    ESP_LOGI(TAG, "attempts %lu, failed %lu, connects %lu (fast %lu), links lost %lu",
+             (unsigned long)stats.attempts, (unsigned long)stats.failed_attempts, (unsigned long)stats.connects,
+             (unsigned long)stats.fast_connects, (unsigned long)stats.links_lost);
+    ESP_LOGI(TAG, "last connect %lu ms (assoc %lu, dhcp %lu), avg %lu ms, max %lu ms",
+             (unsigned long)stats.connect_ms, (unsigned long)stats.assoc_ms, (unsigned long)stats.dhcp_ms,
+             (unsigned long)(stats.connects ? stats.connect_ms_sum / stats.connects : 0),
+             (unsigned long)stats.connect_ms_max);
+    ESP_LOGI(TAG, "uptime %lu s, longest %lu s, total %llu s", (unsigned long)stats.uptime_s,
+             (unsigned long)stats.longest_uptime_s, (unsigned long long)stats.total_uptime_s);
+    for (size_t i = 0; i < stats.disconnect_count; i++)
+    {
+        const WifiDisconnect &d = stats.disconnects[i];
+        ESP_LOGI(TAG, "disconnect at %lld s: reason %u, rssi %d, after %lu s", (long long)(d.time_us / 1000000),
+                 d.reason, d.rssi, (unsigned long)d.connected_s);
+    }
+    if (stats.rssi_count > 0)
+    {
+        int sum = 0;
+        int8_t min = stats.rssi[0];
+        for (size_t i = 0; i < stats.rssi_count; i++)
+        {
+            sum += stats.rssi[i];
+            min = stats.rssi[i] < min ? stats.rssi[i] : min;
+        }
+        ESP_LOGI(TAG, "rssi last %d, avg %d, min %d (%u samples)", stats.rssi[stats.rssi_count - 1],
+                 sum / stats.rssi_count, min, stats.rssi_count);
+    }
+    for (size_t i = 0; i < WIFI_POWER_PROFILE_COUNT; i++)
+    {
+        auto profile = static_cast<WifiPowerProfile>(i);
+        WifiPowerStats power = get_power_stats(profile);
+        if (power.active_ms == 0 && power.transfers == 0)
+            continue;
+        ESP_LOGI(TAG, "power %s: %llu ms, %lu transfers, %llu bytes, latency avg %lu us, max %lu us",
+                 wifi_power_profile_name(profile), (unsigned long long)power.active_ms, (unsigned long)power.transfers,
+                 (unsigned long long)power.bytes,
+                 (unsigned long)(power.transfers ? power.latency_us_sum / power.transfers : 0),
+                 (unsigned long)power.latency_us_max);
+    }
+}
@@ -0,0 +1,306 @@
+#include "wifi.hpp"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_rtc_time.h"
+#include "esp_sntp.h"
+#include "nvs.hpp"
+#include "nvs_async.hpp"
+#include <cmath>
+#include <cstddef>
+#include <sys/time.h>
+#include <time.h>
+
+static const char *TAG = "hv-wifi-time";
+
+#define TIME_SYNCED_BIT BIT0
+
+// Clock state of the last SNTP sync. Kept in RTC memory, which survives deep sleep and
+// software resets, and in NVS, which also survives a power loss.
+struct ClockState
+{
+    uint32_t magic;
+    uint32_t interval_s;   // resync interval derived from drift_ppm
+    int64_t sync_epoch_us; // time received from the server
+    int64_t sync_rtc_us;   // esp_rtc_get_time_us() at that moment, RTC_UNKNOWN after a power loss
+    float drift_ppm;       // rate error of the RTC clock, positive = local clock fast
+    uint32_t drift_valid;
+    uint32_t crc;          // CRC32 over all fields above
+};
+
+static constexpr uint32_t CLOCK_MAGIC = 0x434c4b31; // "CLK1"
+static constexpr int64_t RTC_UNKNOWN = -1;
+// Anything before 2024-01-01 means the clock was never set
+static constexpr time_t MIN_VALID_EPOCH = 1704067200;
+// Shorter sync distances give too coarse a drift estimate
+static constexpr int64_t MIN_DRIFT_WINDOW_US = 10LL * 60 * 1000000;
+
+static constexpr const char *CLOCK_NS = "wifi_cache";
+static constexpr const char *CLOCK_KEY = "clock";
+
+RTC_NOINIT_ATTR static ClockState s_rtc_clock;
+static ClockState s_clock;
+
+static uint32_t clock_crc(const ClockState &state)
+{
+    return esp_rom_crc32_le(0, reinterpret_cast<const uint8_t *>(&state), offsetof(ClockState, crc));
+}
+
+static bool clock_valid(const ClockState &state)
+{
+    return state.magic == CLOCK_MAGIC && state.crc == clock_crc(state);
+}
+
+static int64_t epoch_now_us()
+{
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+static uint32_t interval_for_drift(const ClockState &state)
+{
+    uint32_t interval = CONFIG_HV_WIFI_TIME_MIN_INTERVAL_S;
+    if (state.drift_valid && state.drift_ppm != 0.0f)
+    {
+        // Time until the drift adds up to the allowed error; ppm is microseconds per second
+        double seconds = CONFIG_HV_WIFI_TIME_MAX_ERROR_MS * 1000.0 / std::fabs(state.drift_ppm);
+        interval = seconds > CONFIG_HV_WIFI_TIME_MAX_INTERVAL_S ? CONFIG_HV_WIFI_TIME_MAX_INTERVAL_S
+                                                                 : static_cast<uint32_t>(seconds);
+    }
+    else if (state.drift_valid)
+    {
+        interval = CONFIG_HV_WIFI_TIME_MAX_INTERVAL_S;
+    }
+    return interval < CONFIG_HV_WIFI_TIME_MIN_INTERVAL_S ? CONFIG_HV_WIFI_TIME_MIN_INTERVAL_S : interval;
+}
+
+static void persist_clock(const ClockState &state)
+{
+    s_rtc_clock = state;
+
+    // Called from the lwIP task, which must not wait for flash: time_sync() started the writer
+    esp_err_t err = NvsAsyncWriter::getInstance().write_blob(CLOCK_NS, CLOCK_KEY, &state, sizeof(state));
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Failed to store clock state: %s", esp_err_to_name(err));
+    }
+}
+
+const char *wifi_clock_source_name(WifiClockSource source)
+{
+    switch (source)
+    {
+    case WifiClockSource::NONE:
+        return "none";
+    case WifiClockSource::NVS:
+        return "nvs";
+    case WifiClockSource::RTC:
+        return "rtc";
+    case WifiClockSource::SNTP:
+        return "sntp";
+    }
+    return "?";
+}
+
+void Wifi::restore_clock()
+{
+    bool rtc_ok = clock_valid(s_rtc_clock);
+    if (rtc_ok)
+    {
+        s_clock = s_rtc_clock;
+    }
+    else
+    {
+        // Power loss: the RTC counter restarted, only drift and interval are still meaningful
+        ClockState stored;
+        size_t len = sizeof(stored);
+        Nvs nvs;
+        if (nvs.open_namespace(CLOCK_NS) == ESP_OK && nvs.read_blob(CLOCK_KEY, &stored, len) == ESP_OK &&
+            len == sizeof(stored) && clock_valid(stored))
+        {
+            s_clock = stored;
+            s_clock.sync_rtc_us = RTC_UNKNOWN;
+            s_clock.crc = clock_crc(s_clock);
+        }
+        else
+        {
+            s_clock = {};
+        }
+    }
+
+    if (time(nullptr) >= MIN_VALID_EPOCH)
+    {
+        // System time survived deep sleep or a software reset
+        clock_source_ = rtc_ok ? WifiClockSource::RTC : WifiClockSource::NONE;
+        return;
+    }
+
+    int64_t rtc_now = static_cast<int64_t>(esp_rtc_get_time_us());
+    struct timeval tv = {};
+    if (rtc_ok && s_clock.sync_rtc_us != RTC_UNKNOWN && rtc_now >= s_clock.sync_rtc_us)
+    {
+        int64_t elapsed = rtc_now - s_clock.sync_rtc_us;
+        if (s_clock.drift_valid)
+        {
+            elapsed -= static_cast<int64_t>(elapsed * (s_clock.drift_ppm / 1e6));
+        }
+        int64_t now = s_clock.sync_epoch_us + elapsed;
+        tv.tv_sec = now / 1000000;
+        tv.tv_usec = now % 1000000;
+        settimeofday(&tv, nullptr);
+        clock_source_ = WifiClockSource::RTC;
+    }
+    else if (s_clock.magic == CLOCK_MAGIC)
+    {
+        // Only a lower bound, but dates and ordering of log entries stay plausible
+        tv.tv_sec = s_clock.sync_epoch_us / 1000000;
+        settimeofday(&tv, nullptr);
+        clock_source_ = WifiClockSource::NVS;
+    }
+    else
+    {
+        clock_source_ = WifiClockSource::NONE;
+        return;
+    }
+    ESP_LOGI(TAG, "Clock restored from %s", wifi_clock_source_name(clock_source_));
+}
+
+void Wifi::sntp_sync_cb(struct timeval *tv)
+{
+    auto &wifi = Wifi::getInstance();
+    ClockState state;
+    {
+        std::lock_guard<std::mutex> lock(wifi.getMutex());
+        int64_t epoch_us = static_cast<int64_t>(tv->tv_sec) * 1000000 + tv->tv_usec;
+        int64_t rtc_us = static_cast<int64_t>(esp_rtc_get_time_us());
+
+        state = s_clock;
+        if (state.magic == CLOCK_MAGIC && state.sync_rtc_us != RTC_UNKNOWN && rtc_us > state.sync_rtc_us &&
+            epoch_us - state.sync_epoch_us >= MIN_DRIFT_WINDOW_US)
+        {
+            double server_elapsed = static_cast<double>(epoch_us - state.sync_epoch_us);
+            double local_elapsed = static_cast<double>(rtc_us - state.sync_rtc_us);
+            float ppm = static_cast<float>((local_elapsed - server_elapsed) * 1e6 / server_elapsed);
+            // Smooth out the jitter of single network round trips
+            state.drift_ppm = state.drift_valid ? (state.drift_ppm + ppm) / 2 : ppm;
+            state.drift_valid = 1;
+        }
+
+        state.magic = CLOCK_MAGIC;
+        state.sync_epoch_us = epoch_us;
+        state.sync_rtc_us = rtc_us;
+        state.interval_s = interval_for_drift(state);
+        state.crc = clock_crc(state);
+        s_clock = state;
+        wifi.clock_source_ = WifiClockSource::SNTP;
+
+        // lwIP reads the interval when it schedules the next request after this callback
+        sntp_set_sync_interval(state.interval_s * 1000);
+    }
+
+    ESP_LOGI(TAG, "Time synced, drift %.2f ppm, next sync in %lu s", state.drift_valid ? state.drift_ppm : 0.0f,
+             (unsigned long)state.interval_s);
+    persist_clock(state);
+    xEventGroupSetBits(wifi.time_event_group_, TIME_SYNCED_BIT);
+}
+
+void Wifi::start_sntp()
+{
+    if (esp_sntp_enabled())
+    {
+        return;
+    }
+    esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    esp_sntp_setservername(0, CONFIG_HV_WIFI_TIME_SERVER_0);
+    esp_sntp_setservername(1, CONFIG_HV_WIFI_TIME_SERVER_1);
+    sntp_set_time_sync_notification_cb(&sntp_sync_cb);
+    sntp_set_sync_interval((s_clock.interval_s ? s_clock.interval_s : CONFIG_HV_WIFI_TIME_MIN_INTERVAL_S) * 1000);
+    esp_sntp_init();
+}
+
+void Wifi::sntp_timer_cb(void *arg)
+{
+    auto &wifi = Wifi::getInstance();
+    std::lock_guard<std::mutex> lock(wifi.getMutex());
+    wifi.start_sntp();
+}
+
+bool Wifi::time_sync_due_locked() const
+{
+    if (clock_source_ == WifiClockSource::NONE || clock_source_ == WifiClockSource::NVS)
+    {
+        return true;
+    }
+    return epoch_now_us() - s_clock.sync_epoch_us >= static_cast<int64_t>(s_clock.interval_s) * 1000000;
+}
+
+bool Wifi::time_sync_due() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return time_sync_due_locked();
+}
+
+esp_err_t Wifi::time_sync(bool force)
+{
+    setenv("TZ", CONFIG_HV_WIFI_TIMEZONE, 1);
+    tzset();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!time_event_group_)
+    {
+        time_event_group_ = xEventGroupCreate();
+        esp_timer_create_args_t timer_args = {};
+        timer_args.callback = &sntp_timer_cb;
+        timer_args.name = "wifi_sntp";
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &sntp_timer_));
+        restore_clock();
+
+        // Synced clock states are stored through it, see persist_clock()
+        esp_err_t err = NvsAsyncWriter::getInstance().start();
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+        {
+            ESP_LOGW(TAG, "NVS writer not started, clock state kept in RTC memory only: %s", esp_err_to_name(err));
+        }
+    }
+
+    if (!force && !time_sync_due_locked())
+    {
+        // Clock is good enough, start SNTP only when the next sync is due
+        int64_t remaining = static_cast<int64_t>(s_clock.interval_s) * 1000000 - (epoch_now_us() - s_clock.sync_epoch_us);
+        esp_timer_stop(sntp_timer_);
+        esp_timer_start_once(sntp_timer_, remaining > 0 ? remaining : 0);
+        xEventGroupSetBits(time_event_group_, TIME_SYNCED_BIT);
+        ESP_LOGI(TAG, "Clock valid, next sync in %lld s", (long long)(remaining / 1000000));
+        return ESP_OK;
+    }
+
+    esp_timer_stop(sntp_timer_);
+    start_sntp();
+    return ESP_OK;
+}
+
+esp_err_t Wifi::wait_time_sync(TickType_t timeout)
+{
+    if (!time_event_group_)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    EventBits_t bits = xEventGroupWaitBits(time_event_group_, TIME_SYNCED_BIT, pdFALSE, pdFALSE, timeout);
+    return (bits & TIME_SYNCED_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+WifiClockInfo Wifi::get_clock_info() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    WifiClockInfo info = {};
+    info.source = clock_source_;
+    if (s_clock.magic == CLOCK_MAGIC)
+    {
+        info.last_sync_us = s_clock.sync_epoch_us;
+        info.drift_ppm = s_clock.drift_ppm;
+        info.drift_valid = s_clock.drift_valid != 0;
+        info.interval_s = s_clock.interval_s;
+    }
+    return info;
+}